@@ -26,6 +26,8 @@
 #ifndef _STDEX_CHARMAP_H
 #define _STDEX_CHARMAP_H
 
+#include <stddef.h>
+
 namespace stdex
 {
 
@@ -46,6 +48,22 @@ struct charmap<wchar_t>
 	static constexpr auto mb_len = sizeof(wchar_t);
 };
 
+// UTF-16 and UTF-32, printed in UTF-8 or in the locale's encoding;
+// mb_len is the most bytes one code unit turns into
+template <>
+struct charmap<char16_t>
+{
+	static constexpr auto eol = u'\n';
+	static constexpr size_t mb_len = 3;
+};
+
+template <>
+struct charmap<char32_t>
+{
+	static constexpr auto eol = U'\n';
+	static constexpr size_t mb_len = 4;
+};
+
 }
 
 #endif
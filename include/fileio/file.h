@@ -30,10 +30,15 @@
 #include "polymorphic_allocator.h"
 #include "lock_guard.h"
 #include "charmap.h"
+#include "format_string.h"
 
 #include <memory>
+#include <iterator>
+#include <limits>
 #include <system_error>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <experimental/string_view>
 #include <stdio.h>
 #include <string.h>
@@ -49,7 +54,6 @@
 namespace stdex
 {
 #if !defined(_WIN32)
-#define _isatty ::isatty
 #define _lock_file ::flockfile
 #define _unlock_file ::funlockfile
 #endif
@@ -68,6 +72,8 @@ using std::allocator_arg;
 using xstd::erased_type;
 using std::experimental::string_view;
 using std::experimental::wstring_view;
+using std::experimental::u16string_view;
+using std::experimental::u32string_view;
 
 enum class whence
 {
@@ -78,6 +84,7 @@ enum class whence
 
 enum class opening
 {
+	unbuffered = 0x0000,
 	fully_buffered = 0x0001,
 	line_buffered = 0x0002,
 	buffered = fully_buffered | line_buffered,
@@ -86,6 +93,7 @@ enum class opening
 	append_mode = 0x0010,
 	binary = 0x0020,
 	crlf = binary | 0x0040,
+	shrink_when_idle = 0x0080,
 };
 
 template <typename Enum>
@@ -120,11 +128,97 @@ auto operator|(opening a, opening b) noexcept
 	return _ifflags<opening>(a) | _ifflags<opening>(b);
 }
 
+enum class file_type
+{
+	unknown,
+	regular,
+	directory,
+	character,
+	block,
+	fifo,
+	socket,
+	symlink,
+};
+
+// for print(), a number of digits after the decimal point, as
+// printf's "%.*f" would write them in the "C" locale
+struct fixed
+{
+	explicit fixed(double x, int prec = 6) noexcept :
+		value(x), precision(prec)
+	{}
+
+	double value;
+	int precision;
+};
+
+// likewise with "%.*e"
+struct scientific
+{
+	explicit scientific(double x, int prec = 6) noexcept :
+		value(x), precision(prec)
+	{}
+
+	double value;
+	int precision;
+};
+
+// a minimal std::span, enough to lend out parts of a buffer
+template <typename T>
+struct span
+{
+	constexpr span() noexcept :
+		p_(), n_()
+	{}
+
+	constexpr span(T* p, size_t n) noexcept :
+		p_(p), n_(n)
+	{}
+
+	constexpr T* data() const noexcept
+	{
+		return p_;
+	}
+
+	constexpr size_t size() const noexcept
+	{
+		return n_;
+	}
+
+	constexpr bool empty() const noexcept
+	{
+		return n_ == 0;
+	}
+
+	constexpr T* begin() const noexcept
+	{
+		return p_;
+	}
+
+	constexpr T* end() const noexcept
+	{
+		return p_ + n_;
+	}
+
+	constexpr T& operator[](size_t i) const noexcept
+	{
+		return p_[i];
+	}
+
+private:
+	T* p_;
+	size_t n_;
+};
+
 struct file
 {
 	using off_t = int_least64_t;
 	using allocator_type = erased_type;
 
+	// the alignment with which the buffers are requested from the
+	// memory resource, to tell them apart from the other allocations
+	static constexpr size_t buffer_alignment = alignof(char16_t);
+
 	struct io_result
 	{
 		io_result() noexcept :
@@ -150,6 +244,16 @@ struct file
 		size_t n_;
 	};
 
+	// what is known about the file behind the descriptor; a size
+	// of -1 or a block size of 0 means unknown
+	struct metadata
+	{
+		off_t size = -1;
+		size_t block_size = 0;
+		file_type type = file_type::unknown;
+		bool tty = false;
+	};
+
 private:
 	template <typename T>
 	using being_readable = decltype(std::declval<int&>() =
@@ -189,8 +293,138 @@ private:
 #if defined(WIN32)
 	using ssize_t = ptrdiff_t;
 #endif
+
+	// converts only to the integer types able to count any transfer
+	struct _wide_count
+	{
+		template <typename T, typename = If<bool_constant<
+		    std::is_integral<T>::value and
+		    (std::numeric_limits<T>::max)() >=
+		    (std::numeric_limits<ssize_t>::max)()>>>
+		operator T() const;
+	};
+
+	template <typename R>
+	using wide_result = If<bool_constant<
+	    std::is_integral<R>::value and sizeof(R) >= sizeof(ssize_t)>,
+	    identity_of<R>>;
+
+	template <typename T>
+	using being_wide_readable = wide_result<decltype(
+	    std::declval<T&>().read((char*){}, _wide_count()))>;
+
+	template <typename T>
+	using being_wide_writable = wide_result<decltype(
+	    std::declval<T&>().write((char const*){}, _wide_count()))>;
+
+	// otherwise read and write take int and move at most INT_MAX bytes
+	template <typename T>
+	using is_wide_readable =
+	    detector_of<being_wide_readable>::template call<T>;
+
+	template <typename T>
+	using is_wide_writable =
+	    detector_of<being_wide_writable>::template call<T>;
+
 	using _unspecified_ = _ifflags<opening>;
 
+	// integers other than bool and the character types
+	template <typename T>
+	using is_printed_as_number = and_also
+		<
+		    std::is_integral<T>,
+		    Not<std::is_same<T, bool>>,
+		    Not<std::is_same<T, char>>,
+		    Not<std::is_same<T, wchar_t>>,
+		    Not<std::is_same<T, char16_t>>,
+		    Not<std::is_same<T, char32_t>>
+		>;
+
+	// "-2.2250738585072014e-308"
+	static constexpr size_t max_shortest_length = 24;
+	// longer fixed and scientific forms go through printf
+	static constexpr size_t max_bounded_length = 64;
+
+	// the most bytes a field takes, for print() to check for space
+	// once; _put() writes it in place
+	static size_t _bound(char) noexcept
+	{
+		return 1;
+	}
+
+	static size_t _bound(string_view s) noexcept
+	{
+		return s.size();
+	}
+
+	template <typename T, typename = If<is_printed_as_number<T>>>
+	static size_t _bound(T) noexcept
+	{
+		return std::numeric_limits<T>::digits10 + 2;
+	}
+
+	static size_t _bound(double) noexcept
+	{
+		return max_shortest_length;
+	}
+
+	static size_t _bound(float) noexcept
+	{
+		return max_shortest_length;
+	}
+
+	static void _bound(wchar_t) = delete;
+
+	static char* _put(char* p, char c) noexcept
+	{
+		*p = c;
+		return p + 1;
+	}
+
+	static char* _put(char* p, string_view s) noexcept
+	{
+		if (not s.empty())
+			memcpy(p, s.data(), s.size());
+		return p + s.size();
+	}
+
+	template <typename T, typename = If<is_printed_as_number<T>>>
+	static char* _put(char* p, T x) noexcept
+	{
+		using U = unsigned long long;
+		bool negative = std::is_signed<T>() and x < T();
+		return put_integer(p, negative ? U() - U(x) : U(x), negative);
+	}
+
+	static char* _put(char* p, double x) noexcept
+	{
+		return p + put_shortest(p, x);
+	}
+
+	static char* _put(char* p, float x) noexcept
+	{
+		return p + put_shortest(p, x);
+	}
+
+	template <typename T>
+	using being_printed_in_place =
+	    decltype(_bound(std::declval<T const&>()));
+
+	// otherwise the fields are printed one after another
+	template <typename T>
+	using is_printed_in_place =
+	    detector_of<being_printed_in_place>::template call<T>;
+
+	template <typename... T>
+	struct _last_is_error_code : std::false_type {};
+
+	template <typename T>
+	struct _last_is_error_code<T> :
+	    std::is_same<T, error_code&> {};
+
+	template <typename T, typename... Ts>
+	struct _last_is_error_code<T, Ts...> : _last_is_error_code<Ts...> {};
+
 public:
 	file() noexcept :
 		file(allocator_arg, pmr::get_default_resource())
@@ -202,7 +436,7 @@ public:
 
 	template <typename T, typename =
 	    If<either<is_readable, is_writable>::call<T>>>
-	file(T&& t, _unspecified_ opts, int bufsize = 0) :
+	file(T&& t, _unspecified_ opts, size_t bufsize = 0) :
 		file(allocator_arg, pmr::get_default_resource(),
 		    std::forward<T>(t), opts, bufsize)
 	{}
@@ -210,7 +444,7 @@ public:
 	template <typename T, typename =
 	    If<either<is_readable, is_writable>::call<T>>>
 	file(allocator_arg_t, pmr::memory_resource* mrp, T&& t,
-	    _unspecified_ opts, int bufsize = 0) :
+	    _unspecified_ opts, size_t bufsize = 0) :
 		file(allocator_arg, mrp)
 	{
 		static_assert(std::is_same<decltype(get_fd(t)), int>(),
@@ -252,6 +486,9 @@ public:
 		fd_copy_ = std::move(other.fd_copy_);
 		mr_p_ = std::move(other.mr_p_);
 		mbs_ = std::move(other.mbs_);
+		ap_ = std::move(other.ap_);
+		md_ = std::move(other.md_);
+		md_taken_ = std::move(other.md_taken_);
 
 		return *this;
 	}
@@ -271,6 +508,9 @@ public:
 		swap(lhs.fd_copy_, rhs.fd_copy_);
 		swap(lhs.mr_p_, rhs.mr_p_);
 		swap(lhs.mbs_, rhs.mbs_);
+		swap(lhs.ap_, rhs.ap_);
+		swap(lhs.md_, rhs.md_);
+		swap(lhs.md_taken_, rhs.md_taken_);
 	}
 
 	FILE* locking(nullptr_t)
@@ -301,7 +541,14 @@ public:
 
 	bool isatty() const
 	{
-		return fileno() != -1 && _isatty(fileno());
+		return stat().tty;
+	}
+
+	// Taken once, when first asked for or when the buffer is set up.
+	metadata stat() const
+	{
+		auto _ = make_guard();
+		return metadata_nolock();
 	}
 
 	int fileno() const
@@ -340,6 +587,60 @@ public:
 		return r;
 	}
 
+	io_result read_until(char delim, pmr::string& str)
+	{
+		error_code ec;
+		auto r = read_until(delim, str, ec);
+		if (ec) throw std::system_error(ec);
+
+		return r;
+	}
+
+	string_view read_until(char delim)
+	{
+		error_code ec;
+		auto v = read_until(delim, ec);
+		if (ec) throw std::system_error(ec);
+
+		return v;
+	}
+
+	string_view fill()
+	{
+		error_code ec;
+		auto v = fill(ec);
+		if (ec) throw std::system_error(ec);
+
+		return v;
+	}
+
+	bool skip_space()
+	{
+		error_code ec;
+		auto r = skip_space(ec);
+		if (ec) throw std::system_error(ec);
+
+		return r;
+	}
+
+	bool scan(int64_t& x)
+	{
+		error_code ec;
+		auto r = scan(x, ec);
+		if (ec) throw std::system_error(ec);
+
+		return r;
+	}
+
+	bool scan(double& x)
+	{
+		error_code ec;
+		auto r = scan(x, ec);
+		if (ec) throw std::system_error(ec);
+
+		return r;
+	}
+
 	io_result write(char const* buf, size_t sz)
 	{
 		error_code ec;
@@ -413,6 +714,47 @@ public:
 		if (ec) throw std::system_error(ec);
 	}
 
+	span<char> prepare(size_t n)
+	{
+		error_code ec;
+		auto sp = prepare(n, ec);
+		if (ec) throw std::system_error(ec);
+
+		return sp;
+	}
+
+	void commit(size_t n)
+	{
+		error_code ec;
+		commit(n, ec);
+		if (ec) throw std::system_error(ec);
+	}
+
+	void set_buffering(opening mode, size_t bufsize = 0)
+	{
+		error_code ec;
+		set_buffering(mode, bufsize, ec);
+		if (ec) throw std::system_error(ec);
+	}
+
+	// Returns the buffer to the memory resource if it holds neither
+	// unflushed output nor unread input; the next I/O acquires it again.
+	bool shrink() noexcept
+	{
+		assert(opened());
+		auto _ = make_guard();
+
+		if (bp_ == nullptr or not buffer_idle())
+			return false;
+
+		release_buffer();
+		return true;
+	}
+
+	// Lets the buffer grow or shrink between min_size and max_size
+	// to suit the sizes of the reads and writes seen so far.
+	void adapt_buffer(size_t min_size, size_t max_size);
+
 	io_result read(char& c, error_code& ec)
 	{
 		assert(opened());
@@ -431,6 +773,74 @@ public:
 		return read_nolock(buf, sz, ec);
 	}
 
+	// Appends the input up to and including delim to str.  The result
+	// is true if delim was reached, and counts what was appended.
+	io_result read_until(char delim, pmr::string& str, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return read_until_nolock(delim, str, ec);
+	}
+
+	// Returns the input up to and including delim as a view into the
+	// buffer, or as much of it as the buffer holds; empty at EOF.  The
+	// view is valid until the next operation on the file.
+	string_view read_until(char delim, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return read_until_nolock(delim, ec);
+	}
+
+	// Returns the buffered input, refilling the buffer only if it is
+	// empty; an empty view means EOF or an error.  The view is valid
+	// until the next operation on the file.
+	string_view fill(error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return fill_nolock(ec);
+	}
+
+	// Skips spaces, tabs, and line breaks; false at EOF or an error.
+	bool skip_space(error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return skip_space_nolock(ec);
+	}
+
+	// Skips white space and reads a number in decimal, as strtoll()
+	// and strtod() would in the "C" locale.  Returns false at EOF, or
+	// without reading anything if no number is there; a number out
+	// of range is read but is an error.  One longer than the buffer
+	// is read in pieces, and whatever follows it within the same run
+	// of sign, digit, letter, and point characters is dropped.
+	bool scan(int64_t& x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return scan_nolock(x, ec);
+	}
+
+	bool scan(double& x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return scan_nolock(x, ec);
+	}
+
+	// Marks the first n bytes of what fill() returned as read.
+	void consume(size_t n) noexcept
+	{
+		assert(opened());
+		auto _ = make_guard();
+
+		assert(r_ >= 0 and n <= size_t(r_));
+		p_ += n;
+		r_ -= ssize_t(n);
+	}
+
 	io_result write(char const* buf, size_t sz, error_code& ec)
 	{
 		assert(opened());
@@ -502,6 +912,30 @@ public:
 		close_nolock(ec);
 	}
 
+	// Returns the free part of the write buffer, at least n bytes long,
+	// flushing or enlarging the buffer to make room; empty on error.
+	// Nothing in it is written until commit().
+	span<char> prepare(size_t n, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		return prepare_nolock(n, ec);
+	}
+
+	// Appends the first n bytes of what prepare() returned, then
+	// flushes as write() would.
+	void commit(size_t n, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		commit_nolock(n, ec);
+	}
+
+	// Flushes, then takes the buffering mode and size as if the file
+	// were opened with them.  The buffer is no smaller than the input
+	// it still holds.
+	void set_buffering(opening mode, size_t bufsize, error_code& ec);
+
 	template <typename T>
 	void print(T&& x)
 	{
@@ -534,6 +968,123 @@ public:
 		print_nolock(s.data(), s.size(), ec);
 	}
 
+	// in UTF-8 when that is the locale's codeset
+	void print(u16string_view s, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		print_nolock(s, ec);
+	}
+
+	void print(u32string_view s, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		print_nolock(s, ec);
+	}
+
+	// in decimal; signed char and unsigned char are numbers here
+	template <typename T, typename = If<is_printed_as_number<T>>>
+	void print(T x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+
+		using U = unsigned long long;
+		bool negative = std::is_signed<T>() and x < T();
+		print_integer_nolock(negative ? U() - U(x) : U(x), negative, ec);
+	}
+
+	// the fewest significant digits that read back as x, in the
+	// shorter of the fixed and the scientific notations
+	void print(double x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		print_shortest_nolock(x, ec);
+	}
+
+	void print(float x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		print_shortest_nolock(x, ec);
+	}
+
+	void print(fixed x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		print_precision_nolock(x.value, x.precision, false, ec);
+	}
+
+	void print(scientific x, error_code& ec)
+	{
+		assert(opened());
+		auto _ = make_guard();
+		print_precision_nolock(x.value, x.precision, true, ec);
+	}
+
+	// Prints fmt with each {} replaced by the next argument, as
+	// print() writes it alone, under one lock.  When every field has
+	// a bound on its size, the record is written in place with one
+	// check for space.  An error_code& after the arguments takes the
+	// error instead of an exception.
+	template <typename S, typename... Args>
+	void print(format_string<S> fmt, Args&&... args)
+	{
+		using ends_with_ec = _last_is_error_code<Args&&...>;
+		print_args(ends_with_ec(), fmt, std::forward_as_tuple(args...),
+		    std::make_index_sequence<sizeof...(Args) -
+		    ends_with_ec::value>());
+	}
+
+	// Prints each argument as print() writes it alone, as if with
+	// a format string of nothing but {}; so again one lock, one check
+	// for space, and one flush decision.  print(x, ec) is still the
+	// overload for x.
+	template <typename T, typename U, typename... Ts,
+	    typename = If<bool_constant<
+		not is_format_string<std::decay_t<T>>::value and
+		not (sizeof...(Ts) == 0 and
+		    std::is_same<U&&, error_code&>::value)>>>
+	void print(T&& x, U&& y, Ts&&... args)
+	{
+		using ends_with_ec = _last_is_error_code<U&&, Ts&&...>;
+		using fmt = format_string<_fields_only<sizeof...(Ts) + 2 -
+		    ends_with_ec::value>>;
+		print(fmt(), std::forward<T>(x), std::forward<U>(y),
+		    std::forward<Ts>(args)...);
+	}
+
+	// Reads up to the end of the file into a string allocated from
+	// mrp, going around the buffer.
+	friend
+	pmr::string read_all(file& fh, pmr::memory_resource* mrp,
+	    error_code& ec)
+	{
+		assert(fh.opened());
+		auto _ = fh.make_guard();
+		return fh.read_all_nolock(mrp, ec);
+	}
+
+	friend
+	pmr::string read_all(file& fh, error_code& ec)
+	{
+		return read_all(fh, pmr::get_default_resource(), ec);
+	}
+
+	friend
+	pmr::string read_all(file& fh,
+	    pmr::memory_resource* mrp = pmr::get_default_resource())
+	{
+		error_code ec;
+		auto s = read_all(fh, mrp, ec);
+		if (ec) throw std::system_error(ec);
+
+		return s;
+	}
+
 	~file()
 	{
 		auto _ = make_guard();
@@ -555,8 +1106,14 @@ private:
 		// CRLF implies binary
 		binary = int(opening::binary),
 		crlf = int(opening::crlf),
+		// give the buffer back whenever output leaves it empty;
+		// reads keep it from one refill to the next
+		shrink_when_idle = int(opening::shrink_when_idle),
 		// other states
 		reached_eof = 0x0100,
+		// wide characters go out as UTF-8 without the C library
+		utf8_codeset = 0x0200,
+		codeset_known = 0x0400,
 		reading = 0x1000,
 		writing = 0x2000,
 	};
@@ -583,8 +1140,8 @@ private:
 
 	struct io_interface
 	{
-		virtual int read(char* buf, int n) = 0;
-		virtual int write(char const* buf, int n) = 0;
+		virtual ssize_t read(char* buf, size_t n) = 0;
+		virtual ssize_t write(char const* buf, size_t n) = 0;
 		virtual off_t seek(off_t offset, whence where) = 0;
 		virtual int close() noexcept = 0;
 		virtual int resize(off_t len) = 0;
@@ -605,14 +1162,16 @@ private:
 			rep_(allocator_arg, a, std::move(rep))
 		{}
 
-		int read(char* buf, int n) override
+		ssize_t read(char* buf, size_t n) override
 		{
-			return read(buf, n, is_readable<T>());
+			return read(buf, (std::min)(n, max_count()),
+			    is_readable<T>(), is_wide_readable<T>());
 		}
 
-		int write(char const* buf, int n) override
+		ssize_t write(char const* buf, size_t n) override
 		{
-			return write(buf, n, is_writable<T>());
+			return write(buf, (std::min)(n, max_count()),
+			    is_writable<T>(), is_wide_writable<T>());
 		}
 
 		off_t seek(off_t offset, whence where) override
@@ -638,22 +1197,47 @@ private:
 		}
 
 	private:
-		int read(char* buf, int n, std::true_type)
+		static size_t max_count() noexcept
+		{
+			return size_t((std::numeric_limits<ssize_t>::max)());
+		}
+
+		static int narrowed(size_t n) noexcept
+		{
+			return int((std::min)(n,
+			    size_t((std::numeric_limits<int>::max)())));
+		}
+
+		ssize_t read(char* buf, size_t n, std::true_type, std::true_type)
 		{
 			return obj().read(buf, n);
 		}
 
-		int read(char*, int, std::false_type)
+		ssize_t read(char* buf, size_t n, std::true_type, std::false_type)
+		{
+			return obj().read(buf, narrowed(n));
+		}
+
+		template <typename W>
+		ssize_t read(char*, size_t, std::false_type, W)
 		{
 			return -1;
 		}
 
-		int write(char const* buf, int n, std::true_type)
+		ssize_t write(char const* buf, size_t n, std::true_type,
+		    std::true_type)
 		{
 			return obj().write(buf, n);
 		}
 
-		int write(char const*, int, std::false_type)
+		ssize_t write(char const* buf, size_t n, std::true_type,
+		    std::false_type)
+		{
+			return obj().write(buf, narrowed(n));
+		}
+
+		template <typename W>
+		ssize_t write(char const*, size_t, std::false_type, W)
 		{
 			return -1;
 		}
@@ -735,9 +1319,9 @@ private:
 		return space_left() >= n;
 	}
 
-	int buffer_use() const
+	size_t buffer_use() const
 	{
-		return int(p_ - bp_.get());
+		return size_t(p_ - bp_.get());
 	}
 
 	size_t space_left() const
@@ -745,7 +1329,14 @@ private:
 		return blen_ - buffer_use();
 	}
 
-	bool prepare_to_read()
+	// how many bytes put_fasttrack may store without checking
+	ssize_t write_window() const
+	{
+		return it_is(writing) and buffering() and bp_ != nullptr ?
+		    ssize_t(space_left()) : 0;
+	}
+
+	bool switch_to_reading()
 	{
 		if (it_is(writing))
 		{
@@ -758,6 +1349,14 @@ private:
 		}
 		make_it(reading);
 
+		return true;
+	}
+
+	bool prepare_to_read()
+	{
+		if (!switch_to_reading())
+			return false;
+
 		if (bp_ == nullptr)
 			setup_buffer();
 
@@ -770,12 +1369,34 @@ private:
 		{
 			make_it_not(reading | reached_eof);
 			p_ = bp_.get();
-			w_ = blen_;
+			r_ = 0;
 		}
 		make_it(writing);
 
 		if (buffering() && bp_ == nullptr)
 			setup_buffer();
+		w_ = write_window();
+	}
+
+	bool buffer_idle() const
+	{
+		return it_is(writing) ? buffer_clear() : r_ <= 0;
+	}
+
+	void release_buffer() noexcept
+	{
+		mr_p_->deallocate(bp_.release(), blen_, buffer_alignment);
+		p_ = nullptr;
+		r_ = 0;
+		w_ = 0;
+	}
+
+	// called after output only; a reader would give the buffer back
+	// and take it again on every refill
+	void shrink_if_idle() noexcept
+	{
+		if (it_is(shrink_when_idle) and bp_ != nullptr and buffer_idle())
+			release_buffer();
 	}
 
 	void seek_if_appending()
@@ -784,15 +1405,78 @@ private:
 			(void)fp_->seek(0, whence::ending);
 	}
 
-	static constexpr int default_buffer_size = 8192;
-	static constexpr auto buffer_alignment = alignof(char16_t);
+	static constexpr size_t default_buffer_size = 8192;
 
-	static int rounded_for_buffer(int blen)
+	// request sizes and buffer use recorded for adapt_buffer()
+	struct io_profile
 	{
-		auto x = int(buffer_alignment);
+		static constexpr unsigned period = 32;
+		static constexpr int nbuckets = 48;
+
+		size_t retarget(size_t blen) const;
+
+		size_t clamped(size_t blen) const
+		{
+			return (std::min)((std::max)(blen, min_size), max_size);
+		}
+
+		size_t min_size;
+		size_t max_size;
+		size_t target = 0;
+		unsigned requests = 0;
+		unsigned transfers = 0;
+		unsigned fills = 0;
+		size_t moved = 0;
+		unsigned histogram[nbuckets] = {};
+	};
+
+	void note_request(size_t sz)
+	{
+		if (ap_ != nullptr)
+			adapt_to_request(sz);
+	}
+
+	void note_transfer(size_t n)
+	{
+		if (ap_ != nullptr)
+		{
+			++ap_->transfers;
+			ap_->moved += n;
+			if (n >= blen_)
+				++ap_->fills;
+		}
+	}
+
+	void adapt_to_request(size_t sz);
+	void resize_buffer() noexcept;
+
+	// takes the adapted size while the buffer holds nothing
+	void follow_adapted_size() noexcept
+	{
+		if (ap_ != nullptr and ap_->target != 0 and ap_->target != blen_)
+			resize_buffer();
+	}
+
+	// a buffer to write into holds at least the longest encoding of one
+	// character, or converting a string into it would make no progress
+	static constexpr size_t min_buffer_size = charmap<char32_t>::mb_len;
+
+	static size_t rounded_for_buffer(size_t blen)
+	{
+		auto x = buffer_alignment;
 		return (blen + (x - 1)) / x * x;
 	}
 
+	// the codeset of LC_CTYPE, taken the first time it matters
+	bool wide_as_utf8()
+	{
+		if (it_is_not(codeset_known))
+			take_codeset();
+		return it_is(utf8_codeset);
+	}
+
+	void take_codeset();
+
 #if defined(_WIN32)
 	bool bypass_wchar_conversion() const
 	{
@@ -800,6 +1484,15 @@ private:
 	}
 #endif
 
+	metadata const& metadata_nolock() const
+	{
+		if (not md_taken_)
+			take_metadata();
+		return md_;
+	}
+
+	void take_metadata() const;
+	void decide_buffering();
 	void setup_buffer();
 
 	void copy_buffer_to(char* p, size_t sz)
@@ -839,25 +1532,36 @@ private:
 #if !defined(_WIN32)
 		auto blen = blen_;
 #else
-		auto blen = (std::min)(blen_, 32767);
+		auto blen = (std::min)(blen_, size_t(32767));
 #endif
 		auto x = xswritew(bp_.get(), blen, p_, p, sz);
-		w_ = int(space_left());
+		w_ = ssize_t(space_left());
 		return x;
 	}
 
 	bool xswritew(char* buf, size_t blen, char*& bp, wchar_t const* p,
 	    size_t sz);
 
+	template <typename CharT>
+	bool swriteu_b(CharT const* p, size_t sz);
+	template <typename CharT>
+	bool xswriteu(char* buf, size_t blen, char*& bp, CharT const* p,
+	    size_t sz);
+
 	bool srefill()
 	{
+		follow_adapted_size();
 		p_ = bp_.get();
 		r_ = 0;
 
 		if (it_is(reached_eof))
 			return false;
 
-		switch (auto r = fp_->read(p_, blen_))
+		auto r = fp_->read(p_, blen_);
+		if (r != -1)
+			note_transfer(size_t(r));
+
+		switch (r)
 		{
 		case 0:
 			make_it(reached_eof);
@@ -869,13 +1573,215 @@ private:
 		}
 	}
 
+	// moves what is left to the front and reads after it
+	bool sfill_more()
+	{
+		memmove(bp_.get(), p_, size_t(r_));
+		p_ = bp_.get();
+
+		if (it_is(reached_eof))
+			return false;
+
+		auto r = fp_->read(p_ + r_, blen_ - size_t(r_));
+		if (r != -1)
+			note_transfer(size_t(r));
+
+		switch (r)
+		{
+		case 0:
+			make_it(reached_eof);
+		case -1:
+			return false;
+		default:
+			r_ += r;
+			return true;
+		}
+	}
+
 	io_result read_nolock(char* buf, size_t sz, error_code& ec);
+	string_view fill_nolock(error_code& ec);
+	io_result read_until_nolock(char delim, pmr::string& str,
+	    error_code& ec);
+	string_view read_until_nolock(char delim, error_code& ec);
+	pmr::string read_all_nolock(pmr::memory_resource* mrp,
+	    error_code& ec);
+	bool skip_space_nolock(error_code& ec);
+	string_view number_nolock(bool (*in_number)(char), pmr::string& spill,
+	    error_code& ec);
+	bool scan_nolock(int64_t& x, error_code& ec);
+	bool scan_nolock(double& x, error_code& ec);
 	io_result write_nolock(char const* buf, size_t sz, error_code& ec);
 	io_result get_nolock(char& c, error_code& ec);
 	io_result put_nolock(char c, error_code& ec);
 
+	span<char> prepare_nolock(size_t n, error_code& ec);
+	void commit_nolock(size_t n, error_code& ec);
+
 	void print_nolock(wchar_t const* s, size_t sz, error_code& ec);
 	void print_nolock(wchar_t c, error_code& ec);
+	void print_integer_nolock(unsigned long long v, bool negative,
+	    error_code& ec);
+	void print_shortest_nolock(double x, error_code& ec);
+	void print_shortest_nolock(float x, error_code& ec);
+	void print_precision_nolock(double x, int precision, bool sci,
+	    error_code& ec);
+	void print_printf_nolock(char const* fmt, int precision, double x,
+	    error_code& ec);
+
+	template <typename F>
+	void print_bounded_nolock(size_t most, F format, error_code& ec);
+
+	void print_nolock(char c, error_code& ec)
+	{
+		(void)put_nolock(c, ec);
+	}
+
+	void print_nolock(string_view s, error_code& ec)
+	{
+		(void)write_nolock(s.data(), s.size(), ec);
+	}
+
+	void print_nolock(wstring_view s, error_code& ec)
+	{
+		print_nolock(s.data(), s.size(), ec);
+	}
+
+	void print_nolock(u16string_view s, error_code& ec)
+	{
+		print_unicode_nolock(s.data(), s.size(), ec);
+	}
+
+	void print_nolock(u32string_view s, error_code& ec)
+	{
+		print_unicode_nolock(s.data(), s.size(), ec);
+	}
+
+	template <typename CharT>
+	void print_unicode_nolock(CharT const* s, size_t sz, error_code& ec);
+
+	template <typename T, typename = If<is_printed_as_number<T>>>
+	void print_nolock(T x, error_code& ec)
+	{
+		using U = unsigned long long;
+		bool negative = std::is_signed<T>() and x < T();
+		print_integer_nolock(negative ? U() - U(x) : U(x), negative, ec);
+	}
+
+	void print_nolock(double x, error_code& ec)
+	{
+		print_shortest_nolock(x, ec);
+	}
+
+	void print_nolock(float x, error_code& ec)
+	{
+		print_shortest_nolock(x, ec);
+	}
+
+	void print_nolock(fixed x, error_code& ec)
+	{
+		print_precision_nolock(x.value, x.precision, false, ec);
+	}
+
+	void print_nolock(scientific x, error_code& ec)
+	{
+		print_precision_nolock(x.value, x.precision, true, ec);
+	}
+
+	static char* put_integer(char* p, unsigned long long v,
+	    bool negative) noexcept;
+	static size_t put_shortest(char* p, double x) noexcept;
+	static size_t put_shortest(char* p, float x) noexcept;
+
+	template <typename S, typename Tuple, size_t... I>
+	void print_args(std::true_type, format_string<S> fmt, Tuple t,
+	    std::index_sequence<I...>)
+	{
+		print_format(fmt, std::get<sizeof...(I)>(t), std::get<I>(t)...);
+	}
+
+	template <typename S, typename Tuple, size_t... I>
+	void print_args(std::false_type, format_string<S> fmt, Tuple t,
+	    std::index_sequence<I...>)
+	{
+		error_code ec;
+		print_format(fmt, ec, std::get<I>(t)...);
+		if (ec) throw std::system_error(ec);
+	}
+
+	template <typename S, typename... Args>
+	void print_format(format_string<S>, error_code& ec,
+	    Args const&... args)
+	{
+		static_assert(format_string<S>::well_formed,
+		    "a lone { or } in the format string");
+		static_assert(format_string<S>::fields == sizeof...(Args),
+		    "the format string has not as many {} as arguments");
+
+		assert(opened());
+		auto _ = make_guard();
+		print_format_nolock<S>(and_also<is_printed_in_place<Args>...>(),
+		    std::index_sequence_for<Args...>(), ec, args...);
+	}
+
+	template <typename S, size_t... I, typename... Args>
+	void print_format_nolock(std::true_type, std::index_sequence<I...> is,
+	    error_code& ec, Args const&... args)
+	{
+		using expand = int[];
+		size_t bound = format_string<S>::text_size;
+		(void)expand{ 0, (bound += _bound(args), 0)... };
+
+		// rather than growing the buffer for a long record
+		if (bound > (blen_ == 0 ? default_buffer_size : blen_))
+			return print_format_nolock<S>(std::false_type(), is, ec,
+			    args...);
+
+		auto sp = prepare_nolock(bound, ec);
+		if (sp.data() == nullptr)
+			return;
+
+		auto p = sp.data();
+		(void)expand{ 0, (p = _put(put_text<S, I>(p), args), 0)... };
+		p = put_text<S, sizeof...(I)>(p);
+		commit_nolock(size_t(p - sp.data()), ec);
+	}
+
+	template <typename S, size_t... I, typename... Args>
+	void print_format_nolock(std::false_type, std::index_sequence<I...>,
+	    error_code& ec, Args const&... args)
+	{
+		using expand = int[];
+		(void)expand{ 0, (print_field_nolock<S, I>(args, ec), 0)... };
+		if (not ec)
+			print_text_nolock<S, sizeof...(I)>(ec);
+	}
+
+	template <typename S, size_t I>
+	static char* put_text(char* p) noexcept
+	{
+		using fmt = format_string<S>;
+		memcpy(p, fmt::plan.text + fmt::text_begin(I),
+		    fmt::text_length(I));
+		return p + fmt::text_length(I);
+	}
+
+	template <typename S, size_t I>
+	void print_text_nolock(error_code& ec)
+	{
+		using fmt = format_string<S>;
+		if (fmt::text_length(I) != 0)
+			(void)write_nolock(fmt::plan.text + fmt::text_begin(I),
+			    fmt::text_length(I), ec);
+	}
+
+	template <typename S, size_t I, typename T>
+	void print_field_nolock(T const& x, error_code& ec)
+	{
+		if (not ec)
+			print_text_nolock<S, I>(ec);
+		if (not ec)
+			print_nolock(x, ec);
+	}
 
 	io_result get_fasttrack(char& c)
 	{
@@ -904,6 +1810,7 @@ private:
 	{
 		if (!sflush())
 			report_error(ec, errno);
+		shrink_if_idle();
 	}
 
 	void close_nolock(error_code& ec)
@@ -919,6 +1826,9 @@ private:
 			(void)sclose();
 			fp_.release()->delete_with(mr_p_);
 		}
+		if (ap_)
+			mr_p_->deallocate(ap_.release(), sizeof(io_profile),
+			    alignof(io_profile));
 	}
 
 	struct noop_deleter
@@ -949,17 +1859,131 @@ private:
 	std::unique_ptr<FILE, noop_deleter> xp_;
 	std::unique_ptr<io_interface, noop_deleter> fp_;
 	std::unique_ptr<char[], noop_deleter> bp_;
-	int r_ = 0;
-	int w_ = 0;
+	ssize_t r_ = 0;
+	ssize_t w_ = 0;
 	char* p_ = nullptr;
-	int blen_;
+	size_t blen_;
 	_ifflags<opening>::int_type flags_{};
 	int fd_copy_;
 	pmr::memory_resource* mr_p_;
 	mbstate_t mbs_{};
+	std::unique_ptr<io_profile, noop_deleter> ap_;
+	mutable metadata md_;
+	mutable bool md_taken_ = false;
+};
+
+// The lines of a file without the delimiters, each a view valid until
+// the next one is read.  A line that fits the buffer is viewed in place;
+// a longer one is gathered into a string allocated from mrp, which is
+// reused for the following long lines.
+struct line_range
+{
+	struct iterator
+	{
+		using iterator_category = std::input_iterator_tag;
+		using value_type = string_view;
+		using difference_type = ptrdiff_t;
+		using pointer = string_view const*;
+		using reference = string_view const&;
+
+		iterator() noexcept :
+			rp_()
+		{}
+
+		reference operator*() const
+		{
+			return rp_->cur_;
+		}
+
+		pointer operator->() const
+		{
+			return &rp_->cur_;
+		}
+
+		iterator& operator++()
+		{
+			if (not rp_->next())
+				rp_ = nullptr;
+			return *this;
+		}
+
+		void operator++(int)
+		{
+			++*this;
+		}
+
+		friend
+		bool operator==(iterator const& a, iterator const& b) noexcept
+		{
+			return a.rp_ == b.rp_;
+		}
+
+		friend
+		bool operator!=(iterator const& a, iterator const& b) noexcept
+		{
+			return !(a == b);
+		}
+
+	private:
+		friend line_range;
+
+		explicit iterator(line_range* rp) noexcept :
+			rp_(rp)
+		{}
+
+		line_range* rp_;
+	};
+
+	explicit line_range(file& fh, char delim = '\n',
+	    pmr::memory_resource* mrp = pmr::get_default_resource()) :
+		fh_(&fh), spill_(mrp), delim_(delim)
+	{}
+
+	iterator begin()
+	{
+		return iterator(next() ? this : nullptr);
+	}
+
+	iterator end() noexcept
+	{
+		return {};
+	}
+
+private:
+	bool next()
+	{
+		auto v = fh_->read_until(delim_);
+		if (v.empty())
+			return false;
+
+		if (v.back() != delim_)
+		{
+			spill_.assign(v.data(), v.size());
+			while (spill_.back() != delim_ and
+			    not (v = fh_->read_until(delim_)).empty())
+				spill_.append(v.data(), v.size());
+			v = spill_;
+		}
+
+		if (v.back() == delim_)
+			v.remove_suffix(1);
+		cur_ = v;
+		return true;
+	}
+
+	file* fh_;
+	pmr::string spill_;
+	string_view cur_;
+	char delim_;
 };
 
-#undef _isatty
+inline
+line_range lines(file& fh, char delim = '\n',
+    pmr::memory_resource* mrp = pmr::get_default_resource())
+{
+	return line_range(fh, delim, mrp);
+}
+
 #undef _lock_file
 #undef _unlock_file
 }
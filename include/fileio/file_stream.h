@@ -93,6 +93,17 @@ struct file_stream
 	explicit file_stream(native_handle_type fd) : fd_(fd)
 	{}
 
+#if !defined(_WIN32)
+	ssize_t read(char* buf, size_t n)
+	{
+		return detail::syscall(_read, fd_, buf, n);
+	}
+
+	ssize_t write(char const* buf, size_t n)
+	{
+		return detail::syscall(_write, fd_, buf, n);
+	}
+#else
 	int read(char* buf, int n)
 	{
 		return detail::syscall<int>(_read, fd_, buf, n);
@@ -102,6 +113,7 @@ struct file_stream
 	{
 		return detail::syscall<int>(_write, fd_, buf, n);
 	}
+#endif
 
 	file::off_t seek(file::off_t offset, whence where)
 	{
@@ -195,6 +207,73 @@ file open_file(std::basic_string<CharT, Traits, Alloc> const& path,
 	return open_file(path.data(), mode);
 }
 
+// Reads a whole file into a string; the string and the file are
+// allocated from mrp.
+template <typename CharT>
+inline
+pmr::string slurp(CharT const* path, pmr::memory_resource* mrp,
+    error_code& ec)
+{
+	auto fh = allocate_file(mrp, path, "r", ec);
+	if (ec)
+		return pmr::string(mrp);
+
+	return read_all(fh, mrp, ec);
+}
+
+template <typename CharT>
+inline
+pmr::string slurp(CharT const* path, pmr::memory_resource* mrp)
+{
+	auto fh = allocate_file(mrp, path, "r");
+	return read_all(fh, mrp);
+}
+
+template <typename CharT, typename Traits, typename Alloc>
+inline
+pmr::string slurp(std::basic_string<CharT, Traits, Alloc> const& path,
+    pmr::memory_resource* mrp, error_code& ec)
+{
+	return slurp(path.data(), mrp, ec);
+}
+
+template <typename CharT, typename Traits, typename Alloc>
+inline
+pmr::string slurp(std::basic_string<CharT, Traits, Alloc> const& path,
+    pmr::memory_resource* mrp)
+{
+	return slurp(path.data(), mrp);
+}
+
+template <typename CharT>
+inline
+pmr::string slurp(CharT const* path, error_code& ec)
+{
+	return slurp(path, pmr::get_default_resource(), ec);
+}
+
+template <typename CharT>
+inline
+pmr::string slurp(CharT const* path)
+{
+	return slurp(path, pmr::get_default_resource());
+}
+
+template <typename CharT, typename Traits, typename Alloc>
+inline
+pmr::string slurp(std::basic_string<CharT, Traits, Alloc> const& path,
+    error_code& ec)
+{
+	return slurp(path.data(), ec);
+}
+
+template <typename CharT, typename Traits, typename Alloc>
+inline
+pmr::string slurp(std::basic_string<CharT, Traits, Alloc> const& path)
+{
+	return slurp(path.data());
+}
+
 #undef _read
 #undef _write
 #undef _close
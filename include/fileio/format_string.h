@@ -0,0 +1,172 @@
+/*-
+ * Copyright (c) 2016 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STDEX_FORMAT_STRING_H
+#define _STDEX_FORMAT_STRING_H
+
+#include <stddef.h>
+#include <type_traits>
+
+namespace stdex
+{
+
+// STDEX_FMT("{} took {} ms\n") is a format string split at compile
+// time, for file::print(); each {} stands for the next argument, and
+// {{ and }} for the braces themselves.
+#define STDEX_FMT(s)							\
+	[] {								\
+		struct _fmt						\
+		{							\
+			static constexpr char const* str() { return s; } \
+		};							\
+		return ::stdex::format_string<_fmt>();			\
+	}()
+
+struct _format_counts
+{
+	size_t text;
+	size_t fields;
+	bool well_formed;
+};
+
+constexpr _format_counts _count_format(char const* s)
+{
+	_format_counts r{ 0, 0, true };
+	for (; *s; ++s)
+	{
+		if ((s[0] == '{' or s[0] == '}') and s[1] == s[0])
+		{
+			++r.text;
+			++s;
+		}
+		else if (s[0] == '{' and s[1] == '}')
+		{
+			++r.fields;
+			++s;
+		}
+		else if (s[0] == '{' or s[0] == '}')
+			r.well_formed = false;
+		else
+			++r.text;
+	}
+
+	return r;
+}
+
+// the literal text, unescaped, and where in it the fields go; the
+// last field_at is the end of the text
+template <size_t Text, size_t Fields>
+struct format_plan
+{
+	char text[Text + 1];
+	size_t field_at[Fields + 1];
+};
+
+template <size_t Text, size_t Fields>
+constexpr format_plan<Text, Fields> _plan_format(char const* s)
+{
+	format_plan<Text, Fields> r{};
+	size_t n = 0;
+	size_t k = 0;
+	for (; *s; ++s)
+	{
+		if ((s[0] == '{' or s[0] == '}') and s[1] == s[0])
+			r.text[n++] = *s++;
+		else if (s[0] == '{' and s[1] == '}')
+		{
+			r.field_at[k++] = n;
+			++s;
+		}
+		else
+			r.text[n++] = *s;
+	}
+
+	r.field_at[k] = n;
+	return r;
+}
+
+template <typename S>
+struct format_string
+{
+	static constexpr size_t text_size = _count_format(S::str()).text;
+	static constexpr size_t fields = _count_format(S::str()).fields;
+	static constexpr bool well_formed =
+	    _count_format(S::str()).well_formed;
+
+	static constexpr format_plan<text_size, fields> plan =
+	    _plan_format<text_size, fields>(S::str());
+
+	// the text before field i, or after the last field
+	static constexpr size_t text_begin(size_t i)
+	{
+		return i == 0 ? 0 : plan.field_at[i - 1];
+	}
+
+	static constexpr size_t text_length(size_t i)
+	{
+		return plan.field_at[i] - text_begin(i);
+	}
+};
+
+template <typename S>
+constexpr format_plan<format_string<S>::text_size, format_string<S>::fields>
+    format_string<S>::plan;
+
+// N fields and no text, for print(a, b, ...)
+template <size_t N>
+struct _fields_only;
+
+template <size_t N>
+struct format_string<_fields_only<N>>
+{
+	static constexpr size_t text_size = 0;
+	static constexpr size_t fields = N;
+	static constexpr bool well_formed = true;
+
+	static constexpr format_plan<0, N> plan = {};
+
+	static constexpr size_t text_begin(size_t)
+	{
+		return 0;
+	}
+
+	static constexpr size_t text_length(size_t)
+	{
+		return 0;
+	}
+};
+
+template <size_t N>
+constexpr format_plan<0, N> format_string<_fields_only<N>>::plan;
+
+template <typename T>
+struct is_format_string : std::false_type {};
+
+template <typename S>
+struct is_format_string<format_string<S>> : std::true_type {};
+
+}
+
+#endif
@@ -15,8 +15,11 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <stdlib.h>
+#include <assert.h>
 #include <new>
+#include <string>
 
 BEGIN_NAMESPACE_XSTD
 
@@ -113,6 +116,333 @@ typedef POLYALLOC_RESOURCE_ADAPTOR(std::allocator<char>) new_delete_resource;
 // Return a pointer to a global instance of 'new_delete_resource'.
 new_delete_resource *new_delete_resource_singleton() noexcept;
 
+// A resource which keeps the blocks returned to it in per-size free lists
+// and hands them out again on the next request of the same size and
+// alignment.  Meant for I/O buffers: a program opening and closing many
+// files gets the same few buffers recycled instead of a malloc/free (or
+// mmap/munmap) pair per file.  Requests outside of
+// ['smallest_block', 'largest_block'] go to the upstream resource
+// directly, and so do the sizes beyond the first 'max_sizes' distinct
+// ones seen.  Thread-safe.
+class buffer_pool_resource : public memory_resource
+{
+    static const size_t max_sizes = 16;
+
+    struct bin
+    {
+        size_t bytes;
+        size_t alignment;
+        void  *head;
+        size_t count;
+    };
+
+    memory_resource *m_upstream;
+    size_t           m_max_blocks_per_size;
+    size_t           m_smallest_block;
+    size_t           m_largest_block;
+    bin              m_bins[max_sizes];
+    size_t           m_nbins;
+    mutable mutex    m_mutex;
+
+    bin *find_bin(size_t bytes, size_t alignment);
+
+  public:
+    static const size_t default_max_blocks_per_size = 64;
+    static const size_t default_smallest_block = 4096;
+    static const size_t default_largest_block = 1024 * 1024;
+
+    buffer_pool_resource();
+    explicit buffer_pool_resource(memory_resource *upstream);
+    buffer_pool_resource(size_t max_blocks_per_size, size_t smallest_block,
+                         size_t largest_block,
+                         memory_resource *upstream = nullptr);
+
+    buffer_pool_resource(const buffer_pool_resource&) = delete;
+    buffer_pool_resource& operator=(const buffer_pool_resource&) = delete;
+
+    virtual ~buffer_pool_resource();
+
+    // Return all the cached blocks to the upstream resource.
+    void release();
+
+    // Number of blocks currently cached.
+    size_t cached_blocks() const;
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+
+    virtual void *allocate(size_t bytes, size_t alignment = 0);
+    virtual void deallocate(void *p, size_t bytes, size_t alignment = 0);
+
+    virtual bool is_equal(const memory_resource& other) const;
+};
+
+// A resource which hands out memory from a growing series of chunks and
+// frees nothing until it is destroyed or 'release()'d.  The first chunk can
+// be a buffer supplied by the caller, e.g. an array on the stack, so that a
+// short-lived 'file' and its buffer can be allocated without touching the
+// heap.  Not thread-safe.
+class monotonic_buffer_resource : public memory_resource
+{
+    struct chunk_header;
+
+    memory_resource *m_upstream;
+    void            *m_initial_buffer;
+    size_t           m_initial_size;
+    char            *m_current;
+    size_t           m_space;
+    size_t           m_next_size;
+    chunk_header    *m_chunks;
+
+  public:
+    static const size_t default_initial_size = 1024;
+
+    monotonic_buffer_resource();
+    explicit monotonic_buffer_resource(memory_resource *upstream);
+    explicit monotonic_buffer_resource(size_t initial_size,
+                                       memory_resource *upstream = nullptr);
+    monotonic_buffer_resource(void *buffer, size_t buffer_size,
+                              memory_resource *upstream = nullptr);
+
+    monotonic_buffer_resource(const monotonic_buffer_resource&) = delete;
+    monotonic_buffer_resource& operator=(const monotonic_buffer_resource&)
+        = delete;
+
+    virtual ~monotonic_buffer_resource();
+
+    // Return all the chunks to the upstream resource and start over from the
+    // initial buffer, if any.
+    void release();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+
+    virtual void *allocate(size_t bytes, size_t alignment = 0);
+    virtual void deallocate(void *p, size_t bytes, size_t alignment = 0);
+
+    virtual bool is_equal(const memory_resource& other) const;
+};
+
+// Tuning parameters of the pool resources.  Zero means the default.
+struct pool_options
+{
+    // The most blocks a pool will request from upstream at once.
+    size_t max_blocks_per_chunk = 0;
+
+    // The largest block size served from a pool; larger requests go to the
+    // upstream resource directly.
+    size_t largest_required_pool_block = 0;
+};
+
+// A resource which serves requests from pools of power-of-two block sizes,
+// each carved from chunks obtained from the upstream resource.  Blocks are
+// recycled within their pools and returned to upstream only on 'release()'
+// or destruction.  Not thread-safe.
+class unsynchronized_pool_resource : public memory_resource
+{
+    static const size_t smallest_block = 8;
+    static const size_t max_pools = 32;
+
+    struct chunk_header;
+    struct oversized_header;
+
+    struct pool
+    {
+        void         *free_list;
+        chunk_header *chunks;
+        size_t        next_blocks;
+    };
+
+    memory_resource  *m_upstream;
+    pool_options      m_options;
+    pool              m_pools[max_pools];
+    size_t            m_npools;
+    oversized_header *m_oversized;
+
+    size_t pool_index(size_t bytes, size_t alignment) const;
+    void replenish(size_t index);
+
+    friend class synchronized_pool_resource;
+
+  public:
+    static const size_t default_max_blocks_per_chunk = 1024;
+    static const size_t default_largest_required_pool_block = 64 * 1024;
+    // Pooled blocks are aligned to their size, but not beyond this.
+    static const size_t max_pool_alignment = 16;
+
+    unsynchronized_pool_resource();
+    explicit unsynchronized_pool_resource(memory_resource *upstream);
+    explicit unsynchronized_pool_resource(const pool_options& opts,
+                                          memory_resource *upstream = nullptr);
+
+    unsynchronized_pool_resource(const unsynchronized_pool_resource&)
+        = delete;
+    unsynchronized_pool_resource& operator=(
+        const unsynchronized_pool_resource&) = delete;
+
+    virtual ~unsynchronized_pool_resource();
+
+    // Return all the memory, pooled or not, to the upstream resource.
+    void release();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+    pool_options options() const { return m_options; }
+
+    virtual void *allocate(size_t bytes, size_t alignment = 0);
+    virtual void deallocate(void *p, size_t bytes, size_t alignment = 0);
+
+    virtual bool is_equal(const memory_resource& other) const;
+};
+
+// A thread-safe pool resource.  Each thread keeps a small cache of free
+// blocks per size class, so that most allocations and deallocations touch
+// no lock at all; the caches are refilled from and drained to a shared
+// 'unsynchronized_pool_resource' in batches.  Suitable to be installed with
+// 'set_default_resource' in programs opening files from many threads.
+// 'release()' must not race with any other use of the resource.
+class synchronized_pool_resource : public memory_resource
+{
+    struct thread_cache;
+    struct local_caches;
+
+    static thread_local local_caches s_local_caches;
+
+    unsynchronized_pool_resource m_shared;
+    mutable mutex                m_mutex;
+    thread_cache                *m_caches;
+    size_t                       m_cache_limit;
+    size_t                       m_id;
+
+    thread_cache *local_cache();
+    void drain(thread_cache *c, size_t index, size_t keep);
+
+  public:
+    static const size_t default_cache_limit = 32;
+
+    synchronized_pool_resource();
+    explicit synchronized_pool_resource(memory_resource *upstream);
+    explicit synchronized_pool_resource(const pool_options& opts,
+                                        memory_resource *upstream = nullptr);
+
+    synchronized_pool_resource(const synchronized_pool_resource&) = delete;
+    synchronized_pool_resource& operator=(const synchronized_pool_resource&)
+        = delete;
+
+    virtual ~synchronized_pool_resource();
+
+    // Return all the memory to the upstream resource, emptying the caches of
+    // all the threads.
+    void release();
+
+    memory_resource *upstream_resource() const
+        { return m_shared.upstream_resource(); }
+    pool_options options() const { return m_shared.options(); }
+
+    virtual void *allocate(size_t bytes, size_t alignment = 0);
+    virtual void deallocate(void *p, size_t bytes, size_t alignment = 0);
+
+    virtual bool is_equal(const memory_resource& other) const;
+};
+
+// An adaptor which forwards everything to the upstream resource and counts
+// what passes through, separately for each alignment -- which is what
+// tells the buffers of the 'file' objects, all requested with
+// 'file::buffer_alignment', apart from their other allocations.  Use
+// 'snapshot()' to see the numbers.  Thread-safe.
+class stats_resource : public memory_resource
+{
+  public:
+    // Bucket 'i' counts the requests of (2^(i-1), 2^i] bytes.
+    static const size_t histogram_buckets = 48;
+    // Class 'i' counts the requests aligned to 2^i.  The last class is an
+    // overflow bucket: it sums up the requests of all the alignments of
+    // 2^15 and beyond, and its 'alignment' is only the latest of them.
+    static const size_t alignment_classes = 16;
+
+    struct counters
+    {
+        size_t alignment;
+        size_t allocations;
+        size_t deallocations;
+        size_t bytes_allocated;
+        size_t bytes_deallocated;
+        size_t bytes_in_use;
+        size_t peak_bytes_in_use;
+        size_t histogram[histogram_buckets];
+    };
+
+    struct snapshot_type
+    {
+        // All alignments together; 'alignment' is 0
+        counters total;
+        counters by_alignment[alignment_classes];
+
+        // The counters for the requests of 'alignment', all zero if none;
+        // for an alignment in the overflow bucket, the whole bucket if it
+        // was the latest one counted there, otherwise all zero
+        const counters& for_alignment(size_t alignment) const;
+    };
+
+  private:
+    memory_resource *m_upstream;
+    snapshot_type    m_stats;
+    mutable mutex    m_mutex;
+
+  public:
+    stats_resource();
+    explicit stats_resource(memory_resource *upstream);
+
+    stats_resource(const stats_resource&) = delete;
+    stats_resource& operator=(const stats_resource&) = delete;
+
+    // A consistent copy of all the counters.
+    snapshot_type snapshot() const;
+
+    // Zero the counters, except that the bytes in use are carried over.
+    void reset();
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+
+    virtual void *allocate(size_t bytes, size_t alignment = 0);
+    virtual void deallocate(void *p, size_t bytes, size_t alignment = 0);
+
+    virtual bool is_equal(const memory_resource& other) const;
+};
+
+// A resource which serves the requests of at least 'threshold' bytes with
+// anonymous memory mappings of whole huge pages, so that scanning through
+// a multi-megabyte I/O buffer does not walk through thousands of TLB
+// entries.  Explicit huge pages ('MAP_HUGETLB') are tried first, then
+// transparent huge pages on a huge-page-aligned mapping, then whatever
+// pages the system gives.  Smaller requests, and all the requests on
+// systems without 'mmap', go to the upstream resource.  Thread-safe.
+class huge_page_resource : public memory_resource
+{
+    memory_resource *m_upstream;
+    size_t           m_threshold;
+    size_t           m_page_size;
+
+  public:
+    huge_page_resource();
+    explicit huge_page_resource(memory_resource *upstream);
+    explicit huge_page_resource(size_t threshold,
+                                memory_resource *upstream = nullptr);
+
+    huge_page_resource(const huge_page_resource&) = delete;
+    huge_page_resource& operator=(const huge_page_resource&) = delete;
+
+    // The size of a huge page on this system; mappings are rounded up to
+    // multiples of it.
+    size_t huge_page_size() const { return m_page_size; }
+
+    size_t threshold() const { return m_threshold; }
+
+    memory_resource *upstream_resource() const { return m_upstream; }
+
+    virtual void *allocate(size_t bytes, size_t alignment = 0);
+    virtual void deallocate(void *p, size_t bytes, size_t alignment = 0);
+
+    virtual bool is_equal(const memory_resource& other) const;
+};
+
 // Get the current default resource
 memory_resource *get_default_resource();
 
@@ -172,6 +502,13 @@ template <class T1, class T2>
 bool operator!=(const polymorphic_allocator<T1>& a,
                 const polymorphic_allocator<T2>& b);
 
+template <class CharT, class Traits = std::char_traits<CharT> >
+using basic_string =
+    std::basic_string<CharT, Traits, polymorphic_allocator<CharT> >;
+
+typedef basic_string<char>    string;
+typedef basic_string<wchar_t> wstring;
+
 namespace __details {
 
 template <size_t Align> struct aligned_chunk;
@@ -181,9 +518,17 @@ template <> struct aligned_chunk<2> { short x; };
 template <> struct aligned_chunk<4> { int x; };
 template <> struct aligned_chunk<8> { long long x; };
 template <> struct aligned_chunk<16> { alignas(16) char x; };
-template <> struct aligned_chunk<32> { alignas(32) char x; };
 template <> struct aligned_chunk<64> { alignas(64) char x; };
 
+// Size of a 64-byte-aligned block from which a block of 'bytes' aligned to
+// 'alignment' can be carved after storing a pointer in front of it.
+inline
+size_t overaligned_bytes(size_t bytes, size_t alignment)
+{
+    size_t needed = bytes + sizeof(void*) + alignment - 1;
+    return (needed + 63) / 64 * 64;
+}
+
 } // end namespace __details
     
 } // end namespace polyalloc
@@ -215,9 +560,10 @@ polyalloc::set_default_resource(polyalloc::memory_resource *r)
     if (nullptr == r)
         r = new_delete_resource_singleton();
 
-    // TBD, should use an atomic swap
-    polyalloc::memory_resource *prev = get_default_resource();
-    polyalloc::memory_resource::s_default_resource.store(r);
+    polyalloc::memory_resource *prev =
+        polyalloc::memory_resource::s_default_resource.exchange(r);
+    if (nullptr == prev)
+        prev = new_delete_resource_singleton();
     return prev;
 }
 
@@ -277,11 +623,13 @@ void *polyalloc::resource_adaptor_imp<Allocator>::allocate(size_t bytes,
       case 4: return do_allocate<4>(bytes);
       case 8: return do_allocate<8>(bytes);
       case 16: return do_allocate<16>(bytes);
-      case 32: return do_allocate<32>(bytes);
-      case 64: return do_allocate<64>(bytes);
       default: {
-          size_t chunks = (bytes + sizeof(void*) + alignment - 1) / 64;
-          size_t chunkbytes = chunks * 64;
+          // The allocator only guarantees alignof(max_align_t), so
+          // over-allocate 64-byte chunks with enough room for the original
+          // pointer plus the worst-case padding to the alignment boundary.
+          assert(0 == (alignment & (alignment - 1)) &&
+                 "alignment must be a power of two");
+          size_t chunkbytes = __details::overaligned_bytes(bytes, alignment);
           void *original = do_allocate<64>(chunkbytes);
 
           // Make room for original pointer storage
@@ -319,11 +667,8 @@ void polyalloc::resource_adaptor_imp<Allocator>::deallocate(void   *p,
       case 4: do_deallocate<4>(p, bytes); break;
       case 8: do_deallocate<8>(p, bytes); break;
       case 16: do_deallocate<16>(p, bytes); break;
-      case 32: do_deallocate<32>(p, bytes); break;
-      case 64: do_deallocate<64>(p, bytes); break;
       default: {
-          size_t chunks = (bytes + sizeof(void*) + alignment - 1) / 64;
-          size_t chunkbytes = chunks * 64;
+          size_t chunkbytes = __details::overaligned_bytes(bytes, alignment);
           void *original = reinterpret_cast<void**>(p)[-1];
           
           do_deallocate<64>(original, chunkbytes);
@@ -37,6 +37,9 @@
 #include <sys/param.h>
 #endif
 #include <sys/stat.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
 
 #if !defined(_WIN32)
 #define _isatty ::isatty
@@ -56,6 +59,35 @@ namespace stdex
 
 using cm = charmap<char>;
 
+static
+file_type type_of(unsigned mode)
+{
+	switch (mode & S_IFMT)
+	{
+	case S_IFREG:
+		return file_type::regular;
+	case S_IFDIR:
+		return file_type::directory;
+	case S_IFCHR:
+		return file_type::character;
+#if !defined(_WIN32)
+	case S_IFBLK:
+		return file_type::block;
+	case S_IFIFO:
+		return file_type::fifo;
+	case S_IFSOCK:
+		return file_type::socket;
+	case S_IFLNK:
+		return file_type::symlink;
+#endif
+	default:
+		return file_type::unknown;
+	}
+}
+
+constexpr size_t file::buffer_alignment;
+constexpr size_t file::min_buffer_size;
+
 file::io_result file::read_nolock(char* buf, size_t sz, error_code& ec)
 {
 	if (sz == 0)
@@ -67,6 +99,7 @@ file::io_result file::read_nolock(char* buf, size_t sz, error_code& ec)
 		return {};
 	}
 
+	note_request(sz);
 	bool ok = prepare_to_read();
 	size_t remaining = sz;
 	size_t r;
@@ -82,15 +115,174 @@ file::io_result file::read_nolock(char* buf, size_t sz, error_code& ec)
 	if (ok)
 	{
 		copy_buffer_to(buf, remaining);
-		r_ -= int(remaining);
-		return { ok, sz };
+		r_ -= ssize_t(remaining);
+		remaining = 0;
 	}
-	else
+	else if (it_is_not(reached_eof))
+		report_error(ec, errno);
+
+	return { ok, sz - remaining };
+}
+
+string_view file::fill_nolock(error_code& ec)
+{
+	if (it_is_not(for_read))
+	{
+		report_error(ec, EBADF);
+		return {};
+	}
+
+	bool ok = prepare_to_read();
+
+	if (ok and (r_ > 0 or srefill()))
+		return { p_, size_t(r_) };
+
+	if (it_is_not(reached_eof))
+		report_error(ec, errno);
+	return {};
+}
+
+file::io_result file::read_until_nolock(char delim, pmr::string& str,
+    error_code& ec)
+{
+	if (it_is_not(for_read))
+	{
+		report_error(ec, EBADF);
+		return {};
+	}
+
+	bool ok = prepare_to_read();
+	size_t n = 0;
+
+	while (ok and (r_ > 0 or (ok = srefill())))
+	{
+		auto ep = find(p_, size_t(r_), delim);
+		auto m = ep ? size_t(ep - p_) + 1 : size_t(r_);
+
+		str.append(p_, m);
+		p_ += m;
+		r_ -= ssize_t(m);
+		n += m;
+
+		if (ep)
+			break;
+	}
+
+	if (not ok and it_is_not(reached_eof))
+		report_error(ec, errno);
+
+	return { ok, n };
+}
+
+string_view file::read_until_nolock(char delim, error_code& ec)
+{
+	if (it_is_not(for_read))
+	{
+		report_error(ec, EBADF);
+		return {};
+	}
+
+	if (not prepare_to_read() or (r_ <= 0 and not srefill()))
 	{
 		if (it_is_not(reached_eof))
 			report_error(ec, errno);
-		return { ok, sz - remaining };
+		return {};
+	}
+
+	size_t m;
+	size_t searched = 0;
+	for (;;)
+	{
+		auto ep = find(p_ + searched, size_t(r_) - searched, delim);
+		if (ep)
+		{
+			m = size_t(ep - p_) + 1;
+			break;
+		}
+
+		searched = size_t(r_);
+		m = searched;
+
+		// a line longer than the buffer comes in pieces
+		if (searched == blen_)
+			break;
+
+		if (not sfill_more())
+		{
+			if (it_is_not(reached_eof))
+				report_error(ec, errno);
+			break;
+		}
+	}
+
+	string_view v(p_, m);
+	p_ += m;
+	r_ -= ssize_t(m);
+	return v;
+}
+
+pmr::string file::read_all_nolock(pmr::memory_resource* mrp,
+    error_code& ec)
+{
+	pmr::string s(mrp);
+
+	if (it_is_not(for_read))
+	{
+		report_error(ec, EBADF);
+		return s;
+	}
+
+	// no I/O yet, so the snapshot tells how much there is to read
+	bool fresh = it_is_not(reading | writing);
+	if (not switch_to_reading())
+	{
+		report_error(ec, errno);
+		return s;
+	}
+
+	if (r_ > 0)
+	{
+		s.assign(p_, size_t(r_));
+		p_ += r_;
+		r_ = 0;
+	}
+
+	// files under /proc report a size of zero
+	auto& md = metadata_nolock();
+	bool sized = fresh and md.type == file_type::regular and md.size > 0;
+	auto n = s.size();
+	if (sized)
+		s.resize(n + size_t(md.size));
+
+	while (it_is_not(reached_eof))
+	{
+		if (n == s.size())
+		{
+			// all of it is here, no need to probe for EOF
+			if (sized)
+			{
+				make_it(reached_eof);
+				break;
+			}
+			s.resize((std::max)(n * 2, size_t(default_buffer_size)));
+		}
+
+		auto want = s.size() - n;
+		auto r = fp_->read(&s[n], want);
+		if (r == -1)
+		{
+			report_error(ec, errno);
+			break;
+		}
+
+		// a read may come up short anywhere; only zero means the end
+		n += size_t(r);
+		if (r == 0)
+			make_it(reached_eof);
 	}
+
+	s.resize(n);
+	return s;
 }
 
 file::io_result file::write_nolock(char const* buf, size_t sz, error_code& ec)
@@ -104,6 +296,7 @@ file::io_result file::write_nolock(char const* buf, size_t sz, error_code& ec)
 		return {};
 	}
 
+	note_request(sz);
 	prepare_to_write();
 	size_t written = 0;
 	bool ok;
@@ -146,9 +339,69 @@ file::io_result file::write_nolock(char const* buf, size_t sz, error_code& ec)
 	if (not ok)
 		report_error(ec, errno);
 
+	shrink_if_idle();
 	return { ok, written };
 }
 
+span<char> file::prepare_nolock(size_t n, error_code& ec)
+{
+	if (it_is_not(for_write))
+	{
+		report_error(ec, EBADF);
+		return {};
+	}
+
+	prepare_to_write();
+	// lent out even when unbuffered; commit() writes it at once
+	if (bp_ == nullptr)
+		setup_buffer();
+
+	if (space_left() < n)
+	{
+		if (not sflush())
+		{
+			report_error(ec, errno);
+			return {};
+		}
+
+		if (blen_ < n)
+		{
+			release_buffer();
+			blen_ = rounded_for_buffer(n);
+			setup_buffer();
+		}
+	}
+
+	return { p_, space_left() };
+}
+
+void file::commit_nolock(size_t n, error_code& ec)
+{
+	assert(it_is(writing) and bp_ != nullptr and n <= space_left());
+
+	auto p = p_;
+	p_ += n;
+	w_ = write_window();
+
+	bool ok = true;
+	switch (buffering())
+	{
+	case fully_buffered:
+		break;
+	case line_buffered:
+		if (memchr(p, cm::eol, n) != nullptr)
+			ok = sflush();
+		break;
+	default:
+		ok = sflush();
+	}
+
+	if (not ok)
+		report_error(ec, errno);
+
+	shrink_if_idle();
+}
+
 file::io_result file::get_nolock(char& c, error_code& ec)
 {
 	if (it_is_not(for_read))
@@ -199,6 +452,7 @@ file::io_result file::put_nolock(char c, error_code& ec)
 	else
 		ok = swrite(&c, 1);
 
+	shrink_if_idle();
 	if (ok)
 		return { true, 1 };
 	else
@@ -208,59 +462,236 @@ file::io_result file::put_nolock(char c, error_code& ec)
 	}
 }
 
-void file::setup_buffer()
+void file::take_metadata() const
+{
+	md_taken_ = true;
+	if (fd_copy_ == -1)
+		return;
+
+#if defined(STATX_BASIC_STATS)
+	struct statx stx;
+	if (::statx(fd_copy_, "", AT_EMPTY_PATH, STATX_TYPE | STATX_SIZE,
+	    &stx) == 0)
+	{
+		md_.type = type_of(stx.stx_mode);
+		if (stx.stx_mask & STATX_SIZE)
+			md_.size = off_t(stx.stx_size);
+		md_.block_size = stx.stx_blksize;
+	}
+	else
+#endif
+	{
+		struct _stat64 st;
+		if (_fstat64(fd_copy_, &st) == -1)
+			return;
+
+		md_.type = type_of(st.st_mode);
+		md_.size = off_t(st.st_size);
+		// Windows has no st_blksize, MSYS2 sets erroneous st_blksize
+#if !(defined(_WIN32) || defined(__MSYS__))
+		if (st.st_blksize > 0)
+			md_.block_size = size_t(st.st_blksize);
+#endif
+	}
+
+	md_.tty = md_.type == file_type::character and _isatty(fd_copy_);
+}
+
+void file::decide_buffering()
 {
-	// Windows has no st_blksize, MSYS2 sets erroneous st_blksize
-#if defined(_WIN32) || defined(__MSYS__)
+	auto& md = metadata_nolock();
+
 	if (blen_ == 0)
-		blen_ = default_buffer_size;
+		blen_ = md.block_size == 0 ? default_buffer_size :
+		    rounded_for_buffer(md.block_size);
+	if (ap_)
+	{
+		// a small file to read does not need a larger buffer;
+		// files under /proc report a size of zero
+		if (md.type == file_type::regular and it_is_not(for_write) and
+		    md.size > 0 and size_t(md.size) < blen_)
+			blen_ = rounded_for_buffer(size_t(md.size) + 1);
+		blen_ = ap_->target = ap_->clamped(blen_);
+	}
 	if (buffering() == buffered)
 	{
-		if (isatty())
+		if (md.tty)
 			make_it_not(fully_buffered);
 		else
 			make_it_not(line_buffered);
 	}
-#else
-	struct _stat64 st;
-	if (fd_copy_ == -1 or _fstat64(fd_copy_, &st) == -1)
+}
+
+void file::set_buffering(opening mode, size_t bufsize, error_code& ec)
+{
+	assert(opened());
+	auto _ = make_guard();
+
+	if (it_is(writing) and not sflush())
 	{
-		if (blen_ == 0)
-			blen_ = default_buffer_size;
-		if (buffering() == buffered)
-			make_it_not(line_buffered);
+		report_error(ec, errno);
+		return;
+	}
+
+	make_it_not(buffered);
+	make_it(int(mode) & buffered);
+	if (bufsize != 0 and not buffering())
+		make_it(buffered);
+
+	auto kept = it_is(reading) and r_ > 0 ? size_t(r_) : 0;
+	auto oldlen = blen_;
+	blen_ = rounded_for_buffer(bufsize);
+	if (blen_ == 0 or buffering() == buffered)
+		decide_buffering();
+	auto newlen = (std::max)(blen_, rounded_for_buffer(kept));
+	blen_ = oldlen;
+
+	if (kept == 0)
+	{
+		if (bp_)
+			release_buffer();
 	}
 	else
 	{
-		if (blen_ == 0)
-			blen_ = st.st_blksize <= 0 ?
-			    default_buffer_size : st.st_blksize;
-		if (buffering() == buffered)
-		{
-			if (S_ISCHR(st.st_mode) and _isatty(fd_copy_))
-				make_it_not(fully_buffered);
-			else
-				make_it_not(line_buffered);
-		}
+		auto p = (char*)mr_p_->allocate(newlen, buffer_alignment);
+		memcpy(p, p_, kept);
+		mr_p_->deallocate(bp_.release(), blen_, buffer_alignment);
+		bp_.reset(p);
+		p_ = p;
 	}
-#endif
+
+	blen_ = newlen;
+	if (ap_)
+		ap_->target = newlen;
+	w_ = write_window();
+}
+
+void file::adapt_buffer(size_t min_size, size_t max_size)
+{
+	assert(min_size <= max_size);
+	auto _ = make_guard();
+
+	if (ap_ == nullptr)
+	{
+		pmr::polymorphic_allocator<io_profile> a(mr_p_);
+		auto p = a.allocate(1);
+		a.construct(p);
+		ap_.reset(p);
+	}
+
+	constexpr auto largest =
+	    size_t((std::numeric_limits<ssize_t>::max)()) /
+	    buffer_alignment * buffer_alignment;
+	ap_->max_size = rounded_for_buffer((std::min)(max_size, largest));
+	ap_->min_size = (std::max)(
+	    rounded_for_buffer((std::min)(min_size, largest)),
+	    it_is(for_write) ? min_buffer_size : buffer_alignment);
+	if (ap_->max_size < ap_->min_size)
+		ap_->max_size = ap_->min_size;
+
+	// a size already decided follows the bounds from the next request
+	ap_->target = blen_ == 0 ? 0 : ap_->clamped(blen_);
+}
+
+void file::adapt_to_request(size_t sz)
+{
+	auto& ap = *ap_;
+
+	int k = 0;
+	while (k < io_profile::nbuckets - 1 and (size_t(1) << k) < sz)
+		++k;
+	++ap.histogram[k];
+
+	if (++ap.requests == io_profile::period)
+	{
+		ap.target = ap.retarget(blen_);
+		ap = io_profile{ ap.min_size, ap.max_size, ap.target };
+	}
+
+	// a buffer in use changes size on the next flush or refill
+	if (ap.target != 0 and ap.target != blen_)
+	{
+		if (bp_ == nullptr)
+			blen_ = ap.target;
+		else if (buffer_idle())
+			resize_buffer();
+	}
+}
+
+void file::resize_buffer() noexcept
+{
+	char* p;
+	try
+	{
+		p = (char*)mr_p_->allocate(ap_->target, buffer_alignment);
+	}
+	catch (std::bad_alloc&)
+	{
+		// keep going with the current buffer
+		ap_->target = blen_;
+		return;
+	}
+
+	mr_p_->deallocate(bp_.release(), blen_, buffer_alignment);
+	bp_.reset(p);
+	blen_ = ap_->target;
+	p_ = bp_.get();
+	r_ = 0;
+	w_ = write_window();
+}
+
+size_t file::io_profile::retarget(size_t blen) const
+{
+	if (blen == 0 or transfers == 0)
+		return target;
+
+	// the size nine in ten requests fit in
+	unsigned covered = 0;
+	int k = 0;
+	for (; k < nbuckets - 1; ++k)
+	{
+		covered += histogram[k];
+		if (covered * 10 >= requests * 9)
+			break;
+	}
+	auto typical = size_t(1) << k;
+	auto average = moved / transfers;
+
+	size_t want;
+	if (fills * 4 >= transfers * 3)
+		// the buffer keeps running full; move more per call
+		want = (std::max)(blen * 2, typical);
+	else if (average * 4 < blen)
+		// most of the buffer sits unused
+		want = (std::max)(average * 2, typical);
+	else
+		return blen;
+
+	return clamped(rounded_for_buffer((std::min)(want, max_size)));
+}
+
+void file::setup_buffer()
+{
+	// not again when reacquiring a buffer given back by shrink()
+	if (blen_ == 0 or buffering() == buffered)
+		decide_buffering();
+	if (it_is(for_write) and blen_ < min_buffer_size)
+		blen_ = min_buffer_size;
+
 	assert(blen_ % buffer_alignment == 0);
 	bp_.reset((char*)mr_p_->allocate(blen_, buffer_alignment));
 	p_ = bp_.get();
-	w_ = blen_;
+	r_ = 0;
+	w_ = write_window();
 }
 
 bool file::swrite(char const* p, size_t sz, size_t& written)
 {
-	int n;
+	auto n = sz;
 #if defined(_WIN32)
-	if (sz > 32767 and isatty())
+	if (sz > 32767 and metadata_nolock().tty)
 		n = 32767;
 #endif
-	if (sz > INT_MAX)
-		n = INT_MAX;
-	else
-		n = int(sz);
 
 	seek_if_appending();
 
@@ -269,11 +700,12 @@ bool file::swrite(char const* p, size_t sz, size_t& written)
 		auto r = fp_->write(p, n);
 		if (r == -1)
 			return false;
+		note_transfer(size_t(r));
 		p += r;
 		sz -= r;
 		written += r;
-		if (sz < size_t(n))
-			n = int(sz);
+		if (sz < n)
+			n = sz;
 	}
 
 	return true;
@@ -286,7 +718,7 @@ bool file::swrite_b(char const* p, size_t sz, size_t& written)
 
 	while (ok and sz != 0)
 	{
-		auto m = int(std::min(space_left(), sz));
+		auto m = (std::min)(space_left(), sz);
 
 		// buffer is full
 		if (m == 0)
@@ -303,20 +735,25 @@ bool file::swrite_b(char const* p, size_t sz, size_t& written)
 				seeked = true;
 			}
 #if defined(_WIN32)
-			if (m > 32767 and isatty())
+			if (m > 32767 and metadata_nolock().tty)
 				m = 32767;
 #endif
 			auto r = fp_->write(p, m);
 			ok = (r != -1);
-			p += r;
-			sz -= r;
+			if (ok)
+			{
+				note_transfer(size_t(r));
+				p += r;
+				sz -= r;
+				written += r;
+			}
 		}
 		else
 		{
 			copy_to_buffer(p, m, written);
 			p += m;
 			sz -= m;
-			w_ -= m;
+			w_ -= ssize_t(m);
 		}
 	}
 
@@ -325,10 +762,12 @@ bool file::swrite_b(char const* p, size_t sz, size_t& written)
 
 bool file::sflush()
 {
-	int sz = buffer_use();
-	int n = sz;
+	auto sz = buffer_use();
+	auto n = sz;
+	if (sz != 0)
+		note_transfer(sz);
 #if defined(_WIN32)
-	if (n > 32767 and isatty())
+	if (n > 32767 and metadata_nolock().tty)
 		n = 32767;
 #endif
 	seek_if_appending();
@@ -341,7 +780,7 @@ bool file::sflush()
 		{
 			memmove(bp_.get(), p, sz);
 			p_ = bp_.get() + sz;
-			w_ = blen_ - sz;
+			w_ = write_window();
 
 			return false;
 		}
@@ -351,8 +790,9 @@ bool file::sflush()
 			n = sz;
 	}
 
+	follow_adapted_size();
 	p_ = bp_.get();
-	w_ = blen_;
+	w_ = write_window();
 
 	return true;
 }
@@ -366,7 +806,7 @@ bool file::sclose()
 	auto eno = errno;
 
 	if (bp_)
-		mr_p_->deallocate(bp_.release(), blen_);
+		mr_p_->deallocate(bp_.release(), blen_, buffer_alignment);
 
 	bool closeok = (fp_->close() == 0);
 	if (closeok and not flushok)
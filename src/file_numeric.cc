@@ -0,0 +1,819 @@
+/*-
+ * Copyright (c) 2016 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <fileio/file.h>
+#include "float_tables.h"
+
+#include <ciso646>
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace stdex
+{
+
+static char const digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static
+size_t count_digits(unsigned long long v)
+{
+	size_t n = 1;
+	for (;;)
+	{
+		if (v < 10)
+			return n;
+		if (v < 100)
+			return n + 1;
+		if (v < 1000)
+			return n + 2;
+		if (v < 10000)
+			return n + 3;
+		v /= 10000;
+		n += 4;
+	}
+}
+
+// writes the digits of v two at a time, backward from last;
+// returns where they start
+static
+char* to_digits(char* last, unsigned long long v)
+{
+	while (v >= 100)
+	{
+		auto i = size_t(v % 100) * 2;
+		v /= 100;
+		*--last = digit_pairs[i + 1];
+		*--last = digit_pairs[i];
+	}
+
+	if (v >= 10)
+	{
+		auto i = size_t(v) * 2;
+		*--last = digit_pairs[i + 1];
+		*--last = digit_pairs[i];
+	}
+	else
+		*--last = char('0' + v);
+
+	return last;
+}
+
+// Shortest round-trip digits, after Ulf Adams, "Ryu: Fast Float-to-String
+// Conversion", PLDI 2018.  float goes through the same code as double;
+// the tables are precise enough for both.
+
+struct ieee_double
+{
+	static constexpr int mantissa_bits = 52;
+	static constexpr int exponent_bits = 11;
+	static constexpr int bias = 1023;
+};
+
+struct ieee_float
+{
+	static constexpr int mantissa_bits = 23;
+	static constexpr int exponent_bits = 8;
+	static constexpr int bias = 127;
+};
+
+// digits x 10^exponent
+struct decimal_fp
+{
+	uint64_t digits;
+	int exponent;
+};
+
+// ceil(log2(5^e)), or 1 when e is 0
+static
+int pow5bits(int e)
+{
+	return int(((uint32_t(e) * 1217359) >> 19) + 1);
+}
+
+// floor(log10(2^e))
+static
+int log10_pow2(int e)
+{
+	return int((uint32_t(e) * 78913) >> 18);
+}
+
+// floor(log10(5^e))
+static
+int log10_pow5(int e)
+{
+	return int((uint32_t(e) * 732923) >> 20);
+}
+
+static
+bool multiple_of_pow5(uint64_t v, int p)
+{
+	int n = 0;
+	for (; v % 5 == 0; v /= 5)
+		++n;
+
+	return n >= p;
+}
+
+static
+bool multiple_of_pow2(uint64_t v, int p)
+{
+	return (v & ((uint64_t(1) << p) - 1)) == 0;
+}
+
+#if !defined(__SIZEOF_INT128__)
+static
+uint64_t umul128(uint64_t a, uint64_t b, uint64_t& hi)
+{
+	auto a_lo = uint64_t(uint32_t(a));
+	auto a_hi = a >> 32;
+	auto b_lo = uint64_t(uint32_t(b));
+	auto b_hi = b >> 32;
+
+	auto b00 = a_lo * b_lo;
+	auto b01 = a_lo * b_hi;
+	auto b10 = a_hi * b_lo;
+	auto b11 = a_hi * b_hi;
+
+	auto mid1 = b10 + (b00 >> 32);
+	auto mid2 = b01 + uint32_t(mid1);
+
+	hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+	return (mid2 << 32) | uint32_t(b00);
+}
+#endif
+
+// (m * mul) >> j, where mul is { low, high } and 64 < j < 128
+static
+uint64_t mul_shift(uint64_t m, uint64_t const* mul, int j)
+{
+#if defined(__SIZEOF_INT128__)
+	__extension__ typedef unsigned __int128 uint128;
+
+	auto b0 = uint128(m) * mul[0];
+	auto b2 = uint128(m) * mul[1];
+	return uint64_t(((b0 >> 64) + b2) >> (j - 64));
+#else
+	uint64_t hi0, hi1;
+	umul128(m, mul[0], hi0);
+	auto lo1 = umul128(m, mul[1], hi1);
+	auto sum = hi0 + lo1;
+	if (sum < hi0)
+		++hi1;
+
+	auto dist = j - 64;
+	return (hi1 << (64 - dist)) | (sum >> dist);
+#endif
+}
+
+template <typename Format>
+static
+decimal_fp to_decimal(uint64_t ieee_mantissa, uint32_t ieee_exponent)
+{
+	constexpr int mbits = Format::mantissa_bits;
+
+	// the value is m2 x 2^e2, less 2 to make room for the bounds
+	int e2;
+	uint64_t m2;
+	if (ieee_exponent == 0)
+	{
+		e2 = 1 - Format::bias - mbits - 2;
+		m2 = ieee_mantissa;
+	}
+	else
+	{
+		e2 = int(ieee_exponent) - Format::bias - mbits - 2;
+		m2 = (uint64_t(1) << mbits) | ieee_mantissa;
+	}
+
+	// round-to-even readers take the bounds themselves
+	bool accept_bounds = (m2 & 1) == 0;
+
+	// the halfway points to the neighbours are mv - 1 - mm_shift
+	// and mv + 2; the one below is closer at a power of two
+	auto mv = 4 * m2;
+	uint32_t mm_shift = ieee_mantissa != 0 or ieee_exponent <= 1;
+
+	uint64_t vr, vp, vm;
+	int e10;
+	bool vm_is_trailing_zeros = false;
+	bool vr_is_trailing_zeros = false;
+
+	if (e2 >= 0)
+	{
+		auto q = log10_pow2(e2) - (e2 > 3);
+		e10 = q;
+		auto k = pow5_inv_bitcount + pow5bits(q) - 1;
+		auto i = -e2 + q + k;
+		vr = mul_shift(4 * m2, pow5_inv_split[q], i);
+		vp = mul_shift(4 * m2 + 2, pow5_inv_split[q], i);
+		vm = mul_shift(4 * m2 - 1 - mm_shift, pow5_inv_split[q], i);
+
+		if (q <= 21)
+		{
+			// only one of mv - 1 - mm_shift, mv, and mv + 2 can be
+			// a multiple of 5, if any
+			if (mv % 5 == 0)
+				vr_is_trailing_zeros = multiple_of_pow5(mv, q);
+			else if (accept_bounds)
+				vm_is_trailing_zeros =
+				    multiple_of_pow5(mv - 1 - mm_shift, q);
+			else
+				vp -= multiple_of_pow5(mv + 2, q);
+		}
+	}
+	else
+	{
+		auto q = log10_pow5(-e2) - (-e2 > 1);
+		e10 = q + e2;
+		auto i = -e2 - q;
+		auto k = pow5bits(i) - pow5_bitcount;
+		auto j = q - k;
+		vr = mul_shift(4 * m2, pow5_split[i], j);
+		vp = mul_shift(4 * m2 + 2, pow5_split[i], j);
+		vm = mul_shift(4 * m2 - 1 - mm_shift, pow5_split[i], j);
+
+		if (q <= 1)
+		{
+			// mv has at least q trailing zero bits
+			vr_is_trailing_zeros = true;
+			if (accept_bounds)
+				vm_is_trailing_zeros = mm_shift == 1;
+			else
+				--vp;
+		}
+		else if (q < 63)
+			vr_is_trailing_zeros = multiple_of_pow2(mv, q);
+	}
+
+	// drops digits while the bounds still differ
+	int removed = 0;
+	uint64_t output;
+
+	if (vm_is_trailing_zeros or vr_is_trailing_zeros)
+	{
+		// rare: the exact digits matter for rounding
+		uint32_t last_removed_digit = 0;
+
+		for (; vp / 10 > vm / 10; ++removed)
+		{
+			vm_is_trailing_zeros &= vm % 10 == 0;
+			vr_is_trailing_zeros &= last_removed_digit == 0;
+			last_removed_digit = uint32_t(vr % 10);
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+		}
+
+		if (vm_is_trailing_zeros)
+		{
+			for (; vm % 10 == 0; ++removed)
+			{
+				vr_is_trailing_zeros &= last_removed_digit == 0;
+				last_removed_digit = uint32_t(vr % 10);
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+			}
+		}
+
+		// exactly halfway rounds to even
+		if (vr_is_trailing_zeros and last_removed_digit == 5 and
+		    vr % 2 == 0)
+			last_removed_digit = 4;
+
+		output = vr + ((vr == vm and
+		    (not accept_bounds or not vm_is_trailing_zeros)) or
+		    last_removed_digit >= 5);
+	}
+	else
+	{
+		bool round_up = false;
+
+		if (vp / 100 > vm / 100)
+		{
+			round_up = vr % 100 >= 50;
+			vr /= 100;
+			vp /= 100;
+			vm /= 100;
+			removed += 2;
+		}
+
+		for (; vp / 10 > vm / 10; ++removed)
+		{
+			round_up = vr % 10 >= 5;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+		}
+
+		output = vr + (vr == vm or round_up);
+	}
+
+	return { output, e10 + removed };
+}
+
+// "e+05", "e-123"
+static
+char* put_exponent(char* out, int e)
+{
+	*out++ = 'e';
+	*out++ = e < 0 ? '-' : '+';
+
+	auto abs_e = unsigned(e < 0 ? -e : e);
+	if (abs_e >= 100)
+	{
+		*out++ = char('0' + abs_e / 100);
+		abs_e %= 100;
+	}
+
+	memcpy(out, digit_pairs + abs_e * 2, 2);
+	return out + 2;
+}
+
+// the shorter of the fixed and the scientific notations, fixed on
+// a tie, as to_chars does without a format
+static
+char* to_chars(char* out, decimal_fp v)
+{
+	auto n = int(count_digits(v.digits));
+	auto point = n + v.exponent;
+	auto e = point - 1;
+	auto sci_len = n + (n > 1) + (e <= -100 or e >= 100 ? 5 : 4);
+	auto fixed_len = v.exponent >= 0 ? point :
+	    point > 0 ? n + 1 : n + 2 - point;
+
+	if (fixed_len <= sci_len)
+	{
+		if (v.exponent >= 0)
+		{
+			to_digits(out + n, v.digits);
+			memset(out + n, '0', size_t(v.exponent));
+		}
+		else if (point > 0)
+		{
+			to_digits(out + n + 1, v.digits);
+			memmove(out, out + 1, size_t(point));
+			out[point] = '.';
+		}
+		else
+		{
+			memset(out, '0', size_t(2 - point));
+			out[1] = '.';
+			to_digits(out + fixed_len, v.digits);
+		}
+
+		return out + fixed_len;
+	}
+
+	to_digits(out + n + 1, v.digits);
+	out[0] = out[1];
+	if (n > 1)
+	{
+		out[1] = '.';
+		out += n + 1;
+	}
+	else
+		++out;
+
+	return put_exponent(out, e);
+}
+
+template <typename Format>
+static
+size_t to_shortest(char* out, uint64_t bits)
+{
+	constexpr int mbits = Format::mantissa_bits;
+	constexpr int ebits = Format::exponent_bits;
+
+	auto first = out;
+	auto mantissa = bits & ((uint64_t(1) << mbits) - 1);
+	auto exponent = uint32_t(bits >> mbits) & ((1u << ebits) - 1);
+
+	if ((bits >> (mbits + ebits)) & 1)
+		*out++ = '-';
+
+	if (exponent == (1u << ebits) - 1)
+	{
+		memcpy(out, mantissa ? "nan" : "inf", 3);
+		out += 3;
+	}
+	else if (exponent == 0 and mantissa == 0)
+		*out++ = '0';
+	else
+		out = to_chars(out, to_decimal<Format>(mantissa, exponent));
+
+	return size_t(out - first);
+}
+
+// Fixed and scientific notations to a precision.  The shortest digits
+// are not the exact value, but they are off from it by at most half of
+// the gap between neighbours; where that is too little to move the
+// value across halfway, rounding the digits rounds the value the same
+// way, and what printf would write follows without the exact digits.
+
+static uint64_t const pow10_table[] = {
+	1,
+	10,
+	100,
+	1000,
+	10000,
+	100000,
+	1000000,
+	10000000,
+	100000000,
+	1000000000,
+	10000000000,
+	100000000000,
+	1000000000000,
+	10000000000000,
+	100000000000000,
+	1000000000000000,
+	10000000000000000,
+	100000000000000000,
+};
+
+static constexpr double log2_10 = 3.321928094887362;
+
+// rounds v to a multiple of 10^unit, unless the value, within
+// 2^(gap2 - 1) of v, could round the other way; v.exponent stays
+// at or above unit when nothing is dropped
+static
+bool round_shortest(decimal_fp& v, int unit, int gap2)
+{
+	// log2 of twice the distance to halfway, against gap2 with
+	// room for the error of the logarithms
+	auto clear = [=](double twice_log2)
+	{
+		return twice_log2 > gap2 + 0.01;
+	};
+
+	auto k = unit - v.exponent;
+	if (k <= 0)
+		return clear(unit * log2_10);
+
+	auto n = int(count_digits(v.digits));
+	if (k > n)
+	{
+		// at least four tenths of 10^unit below halfway
+		if (not clear((unit - 1) * log2_10 + 3))
+			return false;
+		v = { 0, unit };
+		return true;
+	}
+
+	auto p10 = pow10_table[k];
+	auto q = v.digits / p10;
+	auto r = v.digits % p10;
+	auto half = p10 / 2;
+	if (r == half)
+		return false;
+
+	auto d = r > half ? r - half : half - r;
+	if (not clear(log2(2. * double(d)) + v.exponent * log2_10))
+		return false;
+
+	v = { q + (r > half), unit };
+	return true;
+}
+
+// x rounded to a precision; length is 0 where printf has to write it
+struct rounded_fp
+{
+	decimal_fp v;
+	int e;  // of the leading digit, for the scientific notation
+	bool negative;
+	size_t length;
+};
+
+static
+rounded_fp to_precision(double x, int precision, bool sci)
+{
+	using Format = ieee_double;
+	constexpr int mbits = Format::mantissa_bits;
+	constexpr int ebits = Format::exponent_bits;
+
+	rounded_fp r = {};
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(x));
+	auto mantissa = bits & ((uint64_t(1) << mbits) - 1);
+	auto exponent = uint32_t(bits >> mbits) & ((1u << ebits) - 1);
+
+	if (exponent == (1u << ebits) - 1)
+		return r;
+
+	r.negative = (bits >> (mbits + ebits)) & 1;
+	auto p = size_t(precision);
+
+	if (exponent == 0 and mantissa == 0)
+	{
+		// "0.000" or "0.000e+00"
+		r.v = { 0, sci ? 0 : -precision };
+	}
+	else
+	{
+		auto gap2 = (exponent == 0 ? 1 : int(exponent)) -
+		    Format::bias - mbits;
+		auto v = to_decimal<Format>(mantissa, exponent);
+
+		if (sci)
+		{
+			auto n = int(count_digits(v.digits));
+			r.e = n + v.exponent - 1;
+
+			// just above a power of ten, the value may be just
+			// below it and take a digit more
+			if (v.digits == pow10_table[n - 1] and
+			    not ((r.e - precision - 1) * log2_10 > gap2 + 0.01))
+				return r;
+
+			if (not round_shortest(v, r.e - precision, gap2))
+				return r;
+
+			// 9.99 to 10.0
+			if (count_digits(v.digits) > p + 1)
+			{
+				v.digits /= 10;
+				++v.exponent;
+				++r.e;
+			}
+		}
+		else if (not round_shortest(v, -precision, gap2))
+			return r;
+
+		r.v = v;
+	}
+
+	if (sci)
+	{
+		auto abs_e = r.e < 0 ? -r.e : r.e;
+		r.length = p + 1 + (p > 0) + (abs_e >= 100 ? 5 : 4);
+	}
+	else
+	{
+		auto len = count_digits(r.v.digits) +
+		    size_t(r.v.exponent + precision);
+		r.length = len > p ? len + (p > 0) : p + 2;
+	}
+
+	r.length += r.negative;
+	return r;
+}
+
+// the digits of v, then zeros down to 10^unit
+static
+char* put_padded(char* out, decimal_fp v, int unit)
+{
+	auto n = count_digits(v.digits);
+	auto zeros = size_t(v.exponent - unit);
+	to_digits(out + n, v.digits);
+	memset(out + n, '0', zeros);
+	return out + n + zeros;
+}
+
+static
+char* put_precision(char* out, rounded_fp const& r, int precision, bool sci)
+{
+	auto p = size_t(precision);
+
+	if (r.negative)
+		*out++ = '-';
+
+	if (sci)
+	{
+		put_padded(out + 1, r.v, r.e - precision);
+		out[0] = out[1];
+		if (p > 0)
+		{
+			out[1] = '.';
+			out += p + 2;
+		}
+		else
+			++out;
+
+		return put_exponent(out, r.e);
+	}
+
+	auto len = count_digits(r.v.digits) +
+	    size_t(r.v.exponent + precision);
+	if (len <= p)
+	{
+		memcpy(out, "0.", 2);
+		memset(out + 2, '0', p - len);
+		return put_padded(out + 2 + (p - len), r.v, -precision);
+	}
+
+	put_padded(out, r.v, -precision);
+	if (p == 0)
+		return out + len;
+
+	memmove(out + len - p + 1, out + len - p, p);
+	out[len - p] = '.';
+	return out + len + 1;
+}
+
+// formats at most `most` bytes with format(char*), in place when
+// the buffer has room
+template <typename F>
+void file::print_bounded_nolock(size_t most, F format, error_code& ec)
+{
+	if (it_is_not(for_write))
+	{
+		report_error(ec, EBADF);
+		return;
+	}
+
+	prepare_to_write();
+	bool ok = true;
+
+	if (buffering() and space_left() < most)
+		ok = sflush();
+
+	if (ok)
+	{
+		if (buffering() and space_left() >= most)
+		{
+			auto n = format(p_);
+			p_ += n;
+			w_ -= ssize_t(n);
+		}
+		else
+		{
+			char buf[max_bounded_length];
+			assert(most <= sizeof(buf));
+			auto n = format(buf);
+			ok = buffering() ? swrite_b(buf, n) : swrite(buf, n);
+		}
+	}
+
+	if (not ok)
+		report_error(ec, errno);
+
+	shrink_if_idle();
+}
+
+size_t file::put_shortest(char* p, double x) noexcept
+{
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(x));
+	return to_shortest<ieee_double>(p, bits);
+}
+
+size_t file::put_shortest(char* p, float x) noexcept
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(x));
+	return to_shortest<ieee_float>(p, bits);
+}
+
+void file::print_shortest_nolock(double x, error_code& ec)
+{
+	print_bounded_nolock(max_shortest_length, [=](char* p)
+	    {
+		return put_shortest(p, x);
+	    }, ec);
+}
+
+void file::print_shortest_nolock(float x, error_code& ec)
+{
+	print_bounded_nolock(max_shortest_length, [=](char* p)
+	    {
+		return put_shortest(p, x);
+	    }, ec);
+}
+
+void file::print_precision_nolock(double x, int precision, bool sci,
+    error_code& ec)
+{
+	// printf takes a negative precision as none; a large one would
+	// not fit anyway
+	rounded_fp r = {};
+	if (precision >= 0 and size_t(precision) < max_bounded_length)
+		r = to_precision(x, precision, sci);
+	if (r.length == 0 or r.length > max_bounded_length)
+		return print_printf_nolock(sci ? "%.*e" : "%.*f", precision, x,
+		    ec);
+
+	print_bounded_nolock(r.length, [&](char* p)
+	    {
+		return size_t(put_precision(p, r, precision, sci) - p);
+	    }, ec);
+}
+
+// printf with the decimal point of the "C" locale
+void file::print_printf_nolock(char const* fmt, int precision, double x,
+    error_code& ec)
+{
+	char buf[64];
+	pmr::string big;
+	auto p = buf;
+	auto n = snprintf(buf, sizeof(buf), fmt, precision, x);
+
+	if (n < 0)
+	{
+		report_error(ec, errno);
+		return;
+	}
+
+	if (size_t(n) >= sizeof(buf))
+	{
+		big.resize(size_t(n) + 1);
+		p = &big[0];
+		snprintf(p, big.size(), fmt, precision, x);
+	}
+
+	auto dp = localeconv()->decimal_point;
+	if (strcmp(dp, ".") != 0)
+	{
+		if (auto it = strstr(p, dp))
+		{
+			auto dplen = strlen(dp);
+			*it = '.';
+			memmove(it + 1, it + dplen, size_t(p + n - it) - dplen);
+			n -= int(dplen - 1);
+		}
+	}
+
+	write_nolock(p, size_t(n), ec);
+}
+
+char* file::put_integer(char* p, unsigned long long v,
+    bool negative) noexcept
+{
+	auto n = count_digits(v) + negative;
+	if (negative)
+		*p = '-';
+	to_digits(p + n, v);
+	return p + n;
+}
+
+void file::print_integer_nolock(unsigned long long v, bool negative,
+    error_code& ec)
+{
+	if (it_is_not(for_write))
+	{
+		report_error(ec, EBADF);
+		return;
+	}
+
+	prepare_to_write();
+	auto n = count_digits(v) + negative;
+	bool ok = true;
+
+	if (buffering() and space_left() < n)
+		ok = sflush();
+
+	if (ok)
+	{
+		if (buffering() and space_left() >= n)
+		{
+			p_ = put_integer(p_, v, negative);
+			w_ -= ssize_t(n);
+		}
+		else
+		{
+			char buf[24];
+			put_integer(buf, v, negative);
+			ok = buffering() ? swrite_b(buf, n) : swrite(buf, n);
+		}
+	}
+
+	if (not ok)
+		report_error(ec, errno);
+
+	shrink_if_idle();
+}
+
+}
@@ -0,0 +1,411 @@
+/*-
+ * Copyright (c) 2016 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <fileio/file.h>
+
+#include <ciso646>
+#include <errno.h>
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+
+namespace stdex
+{
+
+static
+bool is_space(char c)
+{
+	return c == ' ' or (c >= '\t' and c <= '\r');
+}
+
+static
+bool is_digit(char c)
+{
+	return unsigned(c - '0') < 10;
+}
+
+static
+bool in_integer(char c)
+{
+	return is_digit(c) or c == '-' or c == '+';
+}
+
+// also takes the letters, for the exponent, inf, nan, and hex
+static
+bool in_floating(char c)
+{
+	return in_integer(c) or c == '.' or unsigned((c | 0x20) - 'a') < 26;
+}
+
+// eight characters at p, the first in the lowest byte
+static
+uint64_t load8(char const* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static
+bool all_digits(uint64_t v)
+{
+	return ((v & 0xf0f0f0f0f0f0f0f0) |
+	    (((v + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) >> 4)) ==
+	    0x3333333333333333;
+}
+
+// combines the digits pairwise, then by fours
+static
+uint32_t eight_digits(uint64_t v)
+{
+	uint64_t const mask = 0x000000ff000000ff;
+	uint64_t const mul1 = 100 + (uint64_t(1000000) << 32);
+	uint64_t const mul2 = 1 + (uint64_t(10000) << 32);
+
+	v -= 0x3030303030303030;
+	v = v * 10 + (v >> 8);
+	return uint32_t((((v & mask) * mul1) + (((v >> 16) & mask) * mul2))
+	    >> 32);
+}
+
+// accumulates the digits from p into v; returns where they end
+static
+char const* parse_digits(char const* p, char const* last, uint64_t& v)
+{
+	while (last - p >= 8 and all_digits(load8(p)))
+	{
+		v = v * 100000000 + eight_digits(load8(p));
+		p += 8;
+	}
+
+	for (; p != last and is_digit(*p); ++p)
+		v = v * 10 + unsigned(*p - '0');
+
+	return p;
+}
+
+// returns first if there is no number
+static
+char const* parse_integer(char const* first, char const* last, int64_t& x,
+    bool& overflow)
+{
+	auto p = first;
+	bool negative = false;
+	if (p != last and (*p == '-' or *p == '+'))
+		negative = *p++ == '-';
+
+	auto digits = p;
+	while (p != last and *p == '0')
+		++p;
+
+	auto significant = p;
+	uint64_t v = 0;
+	p = parse_digits(p, last, v);
+
+	if (p == digits)
+		return first;
+
+	overflow = p - significant > 19 or
+	    v > uint64_t(std::numeric_limits<int64_t>::max()) + negative;
+	if (not overflow)
+		x = negative ? -int64_t(v - 1) - 1 : int64_t(v);
+
+	return p;
+}
+
+static double const exact_pow10[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Clinger's fast path, for decimals with at most 19 digits whose
+// value and power of ten are both exact in a double; returns nullptr
+// to leave the rest, including inf, nan, and hex, to strtod()
+static
+char const* parse_simple_double(char const* first, char const* last,
+    double& x)
+{
+	auto p = first;
+	bool negative = false;
+	if (p != last and (*p == '-' or *p == '+'))
+		negative = *p++ == '-';
+
+	auto digits = p;
+	while (p != last and *p == '0')
+		++p;
+
+	// 0x...
+	if (p != last and (*p | 0x20) == 'x')
+		return nullptr;
+
+	auto significant = p;
+	uint64_t v = 0;
+	p = parse_digits(p, last, v);
+	auto n = p - significant;
+	auto e10 = 0;
+
+	if (p != last and *p == '.')
+	{
+		auto fraction = ++p;
+		if (n == 0)
+		{
+			while (p != last and *p == '0')
+				++p;
+			significant = p;
+		}
+
+		auto q = parse_digits(p, last, v);
+		n += q - p;
+		e10 = -int(q - fraction);
+		if (q == fraction and digits + 1 == fraction)
+			return nullptr;
+		p = q;
+	}
+	else if (p == digits)
+		return nullptr;
+
+	if (p != last and (*p | 0x20) == 'e')
+	{
+		auto q = p + 1;
+		bool negative_exp = false;
+		if (q != last and (*q == '-' or *q == '+'))
+			negative_exp = *q++ == '-';
+
+		if (q != last and is_digit(*q))
+		{
+			int e = 0;
+			for (; q != last and is_digit(*q); ++q)
+			{
+				if (e < 100000)
+					e = e * 10 + (*q - '0');
+			}
+
+			e10 += negative_exp ? -e : e;
+			p = q;
+		}
+	}
+
+	if (n > 19)
+		return nullptr;
+	else if (v == 0)
+		x = negative ? -0.0 : 0.0;
+	else if (v > (uint64_t(1) << 53) or e10 < -22 or e10 > 22)
+		return nullptr;
+	else
+	{
+		auto d = double(v);
+		d = e10 < 0 ? d / exact_pow10[-e10] : d * exact_pow10[e10];
+		x = negative ? -d : d;
+	}
+
+	return p;
+}
+
+// strtod() in the "C" locale, by putting the locale's decimal point
+// in place of '.'
+static
+char const* parse_double(char const* first, char const* last, double& x,
+    bool& overflow)
+{
+	auto dp = localeconv()->decimal_point;
+	auto dplen = strlen(dp);
+	auto n = size_t(last - first);
+
+	char buf[64];
+	pmr::string big;
+	auto s = buf;
+	if (n + dplen >= sizeof(buf))
+	{
+		big.resize(n + dplen);
+		s = &big[0];
+	}
+
+	auto point = static_cast<char const*>(memchr(first, '.', n));
+	size_t at = point ? size_t(point - first) : n;
+	memcpy(s, first, at);
+	if (point)
+	{
+		memcpy(s + at, dp, dplen);
+		memcpy(s + at + dplen, point + 1, n - at - 1);
+		n += dplen - 1;
+	}
+	s[n] = '\0';
+
+	char* ep;
+	auto saved = errno;
+	errno = 0;
+	auto d = strtod(s, &ep);
+	overflow = errno == ERANGE and isinf(d);
+	errno = saved;
+
+	auto m = size_t(ep - s);
+	if (point and m > at)
+		m -= dplen - 1;
+
+	if (m != 0 and not overflow)
+		x = d;
+
+	return first + m;
+}
+
+bool file::skip_space_nolock(error_code& ec)
+{
+	if (it_is_not(for_read))
+	{
+		report_error(ec, EBADF);
+		return false;
+	}
+
+	if (prepare_to_read())
+	{
+		for (;;)
+		{
+			while (r_ > 0 and is_space(*p_))
+			{
+				++p_;
+				--r_;
+			}
+
+			if (r_ > 0)
+				return true;
+			if (not srefill())
+				break;
+		}
+	}
+
+	if (it_is_not(reached_eof))
+		report_error(ec, errno);
+	return false;
+}
+
+// Keeps the run of characters that in_number() takes in the buffer
+// and returns it, after white space.  A run longer than the buffer is
+// moved to spill and taken out of the buffer.
+string_view file::number_nolock(bool (*in_number)(char), pmr::string& spill,
+    error_code& ec)
+{
+	if (not skip_space_nolock(ec))
+		return {};
+
+	size_t n = 0;
+	for (;;)
+	{
+		while (n < size_t(r_) and in_number(p_[n]))
+			++n;
+
+		if (n < size_t(r_))
+			break;
+
+		bool ok;
+		if (n == blen_)
+		{
+			spill.append(p_, n);
+			p_ += n;
+			r_ = 0;
+			n = 0;
+			ok = srefill();
+		}
+		else
+			ok = sfill_more();
+
+		if (not ok)
+		{
+			if (it_is_not(reached_eof))
+			{
+				report_error(ec, errno);
+				return {};
+			}
+			break;
+		}
+	}
+
+	if (spill.empty())
+		return { p_, n };
+
+	spill.append(p_, n);
+	p_ += n;
+	r_ -= ssize_t(n);
+	return spill;
+}
+
+bool file::scan_nolock(int64_t& x, error_code& ec)
+{
+	pmr::string spill;
+	auto s = number_nolock(in_integer, spill, ec);
+	if (s.empty())
+		return false;
+
+	bool overflow = false;
+	auto first = s.data();
+	auto p = parse_integer(first, first + s.size(), x, overflow);
+	if (spill.empty())
+	{
+		p_ += p - first;
+		r_ -= p - first;
+	}
+
+	if (overflow)
+	{
+		report_error(ec, ERANGE);
+		return false;
+	}
+
+	return p != first;
+}
+
+bool file::scan_nolock(double& x, error_code& ec)
+{
+	pmr::string spill;
+	auto s = number_nolock(in_floating, spill, ec);
+	if (s.empty())
+		return false;
+
+	bool overflow = false;
+	auto first = s.data();
+	auto last = first + s.size();
+	auto p = parse_simple_double(first, last, x);
+	if (p == nullptr)
+		p = parse_double(first, last, x, overflow);
+
+	if (spill.empty())
+	{
+		p_ += p - first;
+		r_ -= p - first;
+	}
+
+	if (overflow)
+	{
+		report_error(ec, ERANGE);
+		return false;
+	}
+
+	return p != first;
+}
+
+}
@@ -31,7 +31,11 @@
 
 #include <iterator>
 #include <ciso646>
+#include <errno.h>
 #include <limits.h>
+#if !defined(_WIN32)
+#include <langinfo.h>
+#endif
 
 using std::next;
 using std::distance;
@@ -41,15 +45,63 @@ namespace stdex
 
 using cm = charmap<wchar_t>;
 
+// UTF-32 to UTF-8; 0 for surrogates and what is beyond Unicode
 static
-bool my_wcrtomb(char* buf, wchar_t c, mbstate_t& mbs, size_t& len)
+size_t utf8_encode(char* p, uint32_t u)
 {
+	if (u < 0x80)
+	{
+		p[0] = char(u);
+		return 1;
+	}
+
+	if (u < 0x800)
+	{
+		p[0] = char(0xc0 | u >> 6);
+		p[1] = char(0x80 | (u & 0x3f));
+		return 2;
+	}
+
+	if (u < 0x10000)
+	{
+		if (u - 0xd800 < 0x800)
+			return 0;
+		p[0] = char(0xe0 | u >> 12);
+		p[1] = char(0x80 | (u >> 6 & 0x3f));
+		p[2] = char(0x80 | (u & 0x3f));
+		return 3;
+	}
+
+	if (u < 0x110000)
+	{
+		p[0] = char(0xf0 | u >> 18);
+		p[1] = char(0x80 | (u >> 12 & 0x3f));
+		p[2] = char(0x80 | (u >> 6 & 0x3f));
+		p[3] = char(0x80 | (u & 0x3f));
+		return 4;
+	}
+
+	return 0;
+}
+
+static
+bool my_wcrtomb(char* buf, wchar_t c, mbstate_t& mbs, size_t& len,
+    bool utf8)
+{
+	if (utf8)
+	{
+		len = utf8_encode(buf, uint32_t(c));
+		if (len == 0)
+			errno = EILSEQ;
+		return len != 0;
+	}
+
 	len = wcrtomb(buf, c, &mbs);
 	return len != (size_t)-1;
 }
 
 static
-int my_wcsnrtombs(char* buf, wchar_t const* s, size_t& nwc, size_t blen,
+int libc_wcsnrtombs(char* buf, wchar_t const* s, size_t& nwc, size_t blen,
     mbstate_t& mbs)
 {
 	auto p = buf;
@@ -83,6 +135,165 @@ int my_wcsnrtombs(char* buf, wchar_t const* s, size_t& nwc, size_t blen,
 	return int(p - buf);
 }
 
+static
+int utf8_wcsnrtombs(char* buf, wchar_t const* s, size_t& nwc, size_t blen)
+{
+	auto p = buf;
+	auto n = nwc;
+
+	while (n != 0)
+	{
+		auto m = narrow_ascii(p, s, (std::min)(n, blen));
+		p += m;
+		s += m;
+		n -= m;
+		blen -= m;
+		if (n == 0 or blen < cm::mb_len)
+			break;
+
+		auto len = utf8_encode(p, uint32_t(*s));
+		if (len == 0)
+		{
+			errno = EILSEQ;
+			return -1;
+		}
+
+		p += len;
+		blen -= len;
+		++s;
+		--n;
+	}
+
+	nwc = n;
+	return int(p - buf);
+}
+
+static
+int my_wcsnrtombs(char* buf, wchar_t const* s, size_t& nwc, size_t blen,
+    mbstate_t& mbs, bool utf8)
+{
+	if (utf8)
+		return utf8_wcsnrtombs(buf, s, nwc, blen);
+
+	auto p = buf;
+	auto n = nwc;
+
+	while (n != 0)
+	{
+		// in the initial shift state, ASCII stands for itself
+		size_t run = n;
+		if (mbsinit(&mbs))
+		{
+			auto m = narrow_ascii(p, s, (std::min)(n, blen));
+			p += m;
+			s += m;
+			n -= m;
+			blen -= m;
+			if (n == 0)
+				break;
+
+			run = 1;
+			while (run < n and unsigned(s[run]) >= 0x80)
+				++run;
+		}
+
+		auto left = run;
+		auto len = libc_wcsnrtombs(p, s, left, blen, mbs);
+		if (len == -1)
+			return -1;
+
+		p += len;
+		blen -= size_t(len);
+		s += run - left;
+		n -= run - left;
+
+		// out of room
+		if (left != 0)
+			break;
+	}
+
+	nwc = n;
+	return int(p - buf);
+}
+
+// the code point at s, of one or two code units; false for lone
+// surrogates and what is beyond Unicode
+static
+bool decode(char16_t const* s, size_t n, uint32_t& c, size_t& units)
+{
+	uint32_t u = s[0];
+	if (u - 0xd800 >= 0x800)
+	{
+		c = u;
+		units = 1;
+		return true;
+	}
+
+	if (u >= 0xdc00 or n < 2 or uint32_t(s[1]) - 0xdc00 >= 0x400)
+		return false;
+
+	c = 0x10000 + ((u - 0xd800) << 10) + (uint32_t(s[1]) - 0xdc00);
+	units = 2;
+	return true;
+}
+
+static
+bool decode(char32_t const* s, size_t, uint32_t& c, size_t& units)
+{
+	c = s[0];
+	units = 1;
+	return c < 0x110000 and c - 0xd800 >= 0x800;
+}
+
+// converts as many code units from s as fit in blen; the locale's
+// converter sees wchar_t, which may not hold every code point
+template <typename CharT>
+static
+int unicode_to_mb(char* buf, CharT const* s, size_t& nu, size_t blen,
+    mbstate_t& mbs, bool utf8)
+{
+	auto p = buf;
+	auto n = nu;
+
+	while (n != 0)
+	{
+		if (utf8 or mbsinit(&mbs))
+		{
+			auto m = narrow_ascii(p, s, (std::min)(n, blen));
+			p += m;
+			s += m;
+			n -= m;
+			blen -= m;
+		}
+
+		if (n == 0 or blen < charmap<char32_t>::mb_len)
+			break;
+
+		uint32_t c;
+		size_t units;
+		size_t len;
+		if (not decode(s, n, c, units) or
+		    (not utf8 and c > uint32_t(WCHAR_MAX)))
+		{
+			errno = EILSEQ;
+			return -1;
+		}
+
+		if (utf8)
+			len = utf8_encode(p, c);
+		else if (not my_wcrtomb(p, wchar_t(c), mbs, len, false))
+			return -1;
+
+		p += len;
+		blen -= len;
+		s += units;
+		n -= units;
+	}
+
+	nu = n;
+	return int(p - buf);
+}
+
 void file::print_nolock(wchar_t const* s, size_t sz, error_code& ec)
 {
 	if (sz == 0)
@@ -144,6 +355,8 @@ void file::print_nolock(wchar_t const* s, size_t sz, error_code& ec)
 
 	if (not ok)
 		report_error(ec, errno);
+
+	shrink_if_idle();
 }
 
 void file::print_nolock(wchar_t c, error_code& ec)
@@ -168,16 +381,17 @@ void file::print_nolock(wchar_t c, error_code& ec)
 			{
 				*p_++ = as_bytes(c)[0];
 				*p_++ = as_bytes(c)[1];
-				w_ -= int(cm::mb_len);
+				w_ -= ssize_t(cm::mb_len);
 			}
 			else
 #endif
 			{
 				size_t len;
-				if ((ok = my_wcrtomb(p_, c, mbs_, len)))
+				if ((ok = my_wcrtomb(p_, c, mbs_, len,
+				    wide_as_utf8())))
 				{
 					p_ += len;
-					w_ -= int(len);
+					w_ -= ssize_t(len);
 				}
 			}
 			if (ok and c == cm::eol and
@@ -195,13 +409,122 @@ void file::print_nolock(wchar_t c, error_code& ec)
 		{
 			char wcb[cm::mb_len];
 			size_t len;
-			if ((ok = my_wcrtomb(wcb, c, mbs_, len)))
+			if ((ok = my_wcrtomb(wcb, c, mbs_, len,
+			    wide_as_utf8())))
 				ok = swrite(wcb, len);
 		}
 	}
 
 	if (not ok)
 		report_error(ec, errno);
+
+	shrink_if_idle();
+}
+
+template <typename CharT>
+void file::print_unicode_nolock(CharT const* s, size_t sz, error_code& ec)
+{
+	if (sz == 0)
+		return;
+
+	if (it_is_not(for_write))
+	{
+		report_error(ec, EBADF);
+		return;
+	}
+
+	prepare_to_write();
+	bool ok = true;
+
+	switch (buffering())
+	{
+	case fully_buffered:
+		ok = swriteu_b(s, sz);
+		break;
+	case line_buffered:
+		{
+			auto ep = rfind(s, sz, charmap<CharT>::eol);
+			auto d = size_t(ep - s);
+			if (d != 0)
+				ok = swriteu_b(s, d) and sflush();
+			ok = ok and swriteu_b(ep, sz - d);
+		}
+		break;
+	default:
+		{
+			char buf[default_buffer_size / 2];
+			auto bp = buf;
+			ok = xswriteu(buf, sizeof(buf), bp, s, sz);
+
+			if (ok and bp != buf)
+				ok = swrite(buf, distance(buf, bp));
+		}
+	}
+
+	if (not ok)
+		report_error(ec, errno);
+
+	shrink_if_idle();
+}
+
+template void file::print_unicode_nolock(char16_t const*, size_t,
+    error_code&);
+template void file::print_unicode_nolock(char32_t const*, size_t,
+    error_code&);
+
+template <typename CharT>
+bool file::swriteu_b(CharT const* p, size_t sz)
+{
+	auto x = xswriteu(bp_.get(), blen_, p_, p, sz);
+	w_ = ssize_t(space_left());
+	return x;
+}
+
+template <typename CharT>
+bool file::xswriteu(char* buf, size_t blen, char*& bp, CharT const* p,
+    size_t sz)
+{
+	seek_if_appending();
+
+	auto d = size_t(bp - buf);
+	auto n = sz;
+	auto utf8 = wide_as_utf8();
+
+	for (;;)
+	{
+		auto len = unicode_to_mb(bp, p + (sz - n), n, blen - d, mbs_,
+		    utf8);
+		if (len == -1)
+			return false;
+		d += size_t(len);
+
+		if (n == 0)
+		{
+			bp = buf + d;
+			break;
+		}
+
+		auto r = fp_->write(buf, d);
+		if (r == -1)
+			return false;
+		d -= size_t(r);
+		memmove(buf, buf + r, d);
+		bp = buf + d;
+	}
+
+	return true;
+}
+
+// only where wchar_t holds UTF-32
+void file::take_codeset()
+{
+#if !defined(_WIN32)
+	auto cs = nl_langinfo(CODESET);
+	if (sizeof(wchar_t) == 4 and
+	    (strcmp(cs, "UTF-8") == 0 or strcmp(cs, "utf8") == 0))
+		make_it(utf8_codeset);
+#endif
+	make_it(codeset_known);
 }
 
 bool file::xswritew(char* buf, size_t blen, char*& bp, wchar_t const* p,
@@ -209,15 +532,17 @@ bool file::xswritew(char* buf, size_t blen, char*& bp, wchar_t const* p,
 {
 	seek_if_appending();
 
-	auto d = int(bp - buf);
+	auto d = size_t(bp - buf);
 	auto n = sz;
+	auto utf8 = wide_as_utf8();
 
 	for (;;)
 	{
-		auto len = my_wcsnrtombs(bp, p + (sz - n), n, blen - d, mbs_);
+		auto len = my_wcsnrtombs(bp, p + (sz - n), n, blen - d, mbs_,
+		    utf8);
 		if (len == -1)
 			return false;
-		d += len;
+		d += size_t(len);
 
 		if (n == 0)
 		{
@@ -8,6 +8,15 @@
 
 #include <fileio/polymorphic_allocator.h>
 
+#include <vector>
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
 BEGIN_NAMESPACE_XSTD
 
 atomic<polyalloc::memory_resource *>
@@ -22,6 +31,927 @@ polyalloc::new_delete_resource *polyalloc::new_delete_resource_singleton()
     return &singleton;
 }
 
+namespace {
+
+// Same as what 'resource_adaptor' chooses for an alignment of 0, so that a
+// block allocated with 0 and deallocated with its natural alignment (or the
+// other way around) lands in the same bin.
+size_t natural_alignment(size_t bytes, size_t alignment)
+{
+    static const size_t max_natural_alignment = sizeof(max_align_t);
+
+    if (0 == alignment) {
+        alignment = ((bytes ^ (bytes - 1)) >> 1) + 1;
+        if (alignment > max_natural_alignment)
+            alignment = max_natural_alignment;
+    }
+
+    return alignment;
+}
+
+size_t round_up(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+// Carve 'bytes' aligned to 'alignment' from the front of the free region
+// ['current', 'current + space'), or return null if it does not fit.
+void *carve(size_t bytes, size_t alignment, char *&current, size_t& space)
+{
+    size_t pad = (0 - size_t(current)) & (alignment - 1);
+    if (!current || pad > space || bytes > space - pad)
+        return nullptr;
+
+    char *p = current + pad;
+    current = p + bytes;
+    space -= pad + bytes;
+    return p;
+}
+
+} // end unnamed namespace
+
+polyalloc::buffer_pool_resource::buffer_pool_resource()
+    : buffer_pool_resource(default_max_blocks_per_size,
+                           default_smallest_block, default_largest_block)
+{
+}
+
+polyalloc::buffer_pool_resource::buffer_pool_resource(
+    memory_resource *upstream)
+    : buffer_pool_resource(default_max_blocks_per_size,
+                           default_smallest_block, default_largest_block,
+                           upstream)
+{
+}
+
+polyalloc::buffer_pool_resource::buffer_pool_resource(
+    size_t           max_blocks_per_size,
+    size_t           smallest_block,
+    size_t           largest_block,
+    memory_resource *upstream)
+    : m_upstream(upstream ? upstream : get_default_resource())
+    , m_max_blocks_per_size(max_blocks_per_size)
+    // A free block stores the link to the next one
+    , m_smallest_block(smallest_block < sizeof(void*) ?
+                       sizeof(void*) : smallest_block)
+    , m_largest_block(largest_block)
+    , m_bins()
+    , m_nbins(0)
+{
+}
+
+polyalloc::buffer_pool_resource::~buffer_pool_resource()
+{
+    release();
+}
+
+void polyalloc::buffer_pool_resource::release()
+{
+    lock_guard<mutex> guard(m_mutex);
+
+    for (size_t i = 0; i < m_nbins; ++i) {
+        bin& b = m_bins[i];
+        while (b.head) {
+            void *p = b.head;
+            b.head = *static_cast<void**>(p);
+            m_upstream->deallocate(p, b.bytes, b.alignment);
+        }
+        b.count = 0;
+    }
+}
+
+size_t polyalloc::buffer_pool_resource::cached_blocks() const
+{
+    lock_guard<mutex> guard(m_mutex);
+
+    size_t n = 0;
+    for (size_t i = 0; i < m_nbins; ++i)
+        n += m_bins[i].count;
+    return n;
+}
+
+polyalloc::buffer_pool_resource::bin *
+polyalloc::buffer_pool_resource::find_bin(size_t bytes, size_t alignment)
+{
+    if (bytes < m_smallest_block || bytes > m_largest_block)
+        return nullptr;
+
+    for (size_t i = 0; i < m_nbins; ++i) {
+        bin& b = m_bins[i];
+        if (b.bytes == bytes && b.alignment == alignment)
+            return &b;
+    }
+
+    if (m_nbins == max_sizes)
+        return nullptr;
+
+    bin& b = m_bins[m_nbins++];
+    b.bytes = bytes;
+    b.alignment = alignment;
+    b.head = nullptr;
+    b.count = 0;
+    return &b;
+}
+
+void *polyalloc::buffer_pool_resource::allocate(size_t bytes,
+                                                size_t alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+
+    {
+        lock_guard<mutex> guard(m_mutex);
+
+        bin *b = find_bin(bytes, alignment);
+        if (b && b->head) {
+            void *p = b->head;
+            b->head = *static_cast<void**>(p);
+            --b->count;
+            return p;
+        }
+    }
+
+    return m_upstream->allocate(bytes, alignment);
+}
+
+void polyalloc::buffer_pool_resource::deallocate(void   *p,
+                                                 size_t  bytes,
+                                                 size_t  alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+
+    {
+        lock_guard<mutex> guard(m_mutex);
+
+        bin *b = find_bin(bytes, alignment);
+        if (b && b->count < m_max_blocks_per_size) {
+            *static_cast<void**>(p) = b->head;
+            b->head = p;
+            ++b->count;
+            return;
+        }
+    }
+
+    m_upstream->deallocate(p, bytes, alignment);
+}
+
+bool polyalloc::buffer_pool_resource::is_equal(
+    const memory_resource& other) const
+{
+    return this == &other;
+}
+
+struct polyalloc::monotonic_buffer_resource::chunk_header
+{
+    chunk_header *next;
+    size_t        bytes;
+};
+
+polyalloc::monotonic_buffer_resource::monotonic_buffer_resource()
+    : monotonic_buffer_resource(default_initial_size)
+{
+}
+
+polyalloc::monotonic_buffer_resource::monotonic_buffer_resource(
+    memory_resource *upstream)
+    : monotonic_buffer_resource(default_initial_size, upstream)
+{
+}
+
+polyalloc::monotonic_buffer_resource::monotonic_buffer_resource(
+    size_t           initial_size,
+    memory_resource *upstream)
+    : monotonic_buffer_resource(nullptr, initial_size, upstream)
+{
+}
+
+polyalloc::monotonic_buffer_resource::monotonic_buffer_resource(
+    void            *buffer,
+    size_t           buffer_size,
+    memory_resource *upstream)
+    : m_upstream(upstream ? upstream : get_default_resource())
+    , m_initial_buffer(buffer)
+    , m_initial_size(buffer_size)
+    , m_chunks(nullptr)
+{
+    release();
+}
+
+polyalloc::monotonic_buffer_resource::~monotonic_buffer_resource()
+{
+    release();
+}
+
+void polyalloc::monotonic_buffer_resource::release()
+{
+    while (m_chunks) {
+        chunk_header *h = m_chunks;
+        m_chunks = h->next;
+        m_upstream->deallocate(h, h->bytes, alignof(chunk_header));
+    }
+
+    m_current = static_cast<char*>(m_initial_buffer);
+    m_space = m_initial_buffer ? m_initial_size : 0;
+    m_next_size = m_initial_size < default_initial_size ?
+                  default_initial_size : m_initial_size;
+}
+
+void *polyalloc::monotonic_buffer_resource::allocate(size_t bytes,
+                                                     size_t alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+    assert((alignment & (alignment - 1)) == 0);
+
+    if (void *p = carve(bytes, alignment, m_current, m_space))
+        return p;
+
+    size_t needed = sizeof(chunk_header) + alignment + bytes;
+    size_t chunk_bytes = m_next_size < needed ? needed : m_next_size;
+
+    void *chunk = m_upstream->allocate(chunk_bytes, alignof(chunk_header));
+    chunk_header *h = static_cast<chunk_header*>(chunk);
+    h->next = m_chunks;
+    h->bytes = chunk_bytes;
+    m_chunks = h;
+
+    m_current = reinterpret_cast<char*>(h + 1);
+    m_space = chunk_bytes - sizeof(chunk_header);
+    m_next_size = chunk_bytes * 2;
+
+    return carve(bytes, alignment, m_current, m_space);
+}
+
+void polyalloc::monotonic_buffer_resource::deallocate(void *, size_t, size_t)
+{
+}
+
+bool polyalloc::monotonic_buffer_resource::is_equal(
+    const memory_resource& other) const
+{
+    return this == &other;
+}
+
+struct polyalloc::unsynchronized_pool_resource::chunk_header
+{
+    chunk_header *next;
+    size_t        bytes;
+    size_t        alignment;
+};
+
+struct polyalloc::unsynchronized_pool_resource::oversized_header
+{
+    oversized_header *prev;
+    oversized_header *next;
+    size_t            bytes;
+    size_t            alignment;
+};
+
+polyalloc::unsynchronized_pool_resource::unsynchronized_pool_resource()
+    : unsynchronized_pool_resource(pool_options())
+{
+}
+
+polyalloc::unsynchronized_pool_resource::unsynchronized_pool_resource(
+    memory_resource *upstream)
+    : unsynchronized_pool_resource(pool_options(), upstream)
+{
+}
+
+polyalloc::unsynchronized_pool_resource::unsynchronized_pool_resource(
+    const pool_options&  opts,
+    memory_resource     *upstream)
+    : m_upstream(upstream ? upstream : get_default_resource())
+    , m_options(opts)
+    , m_pools()
+    , m_npools(0)
+    , m_oversized(nullptr)
+{
+    static const size_t largest_block = smallest_block << (max_pools - 1);
+
+    if (0 == m_options.max_blocks_per_chunk)
+        m_options.max_blocks_per_chunk = default_max_blocks_per_chunk;
+
+    size_t& largest = m_options.largest_required_pool_block;
+    if (0 == largest)
+        largest = default_largest_required_pool_block;
+    else if (largest > largest_block)
+        largest = largest_block;
+
+    size_t block = smallest_block;
+    do {
+        ++m_npools;
+        if (block >= largest)
+            break;
+        block <<= 1;
+    } while (true);
+    largest = block;
+}
+
+polyalloc::unsynchronized_pool_resource::~unsynchronized_pool_resource()
+{
+    release();
+}
+
+void polyalloc::unsynchronized_pool_resource::release()
+{
+    for (size_t i = 0; i < m_npools; ++i) {
+        pool& pl = m_pools[i];
+        while (pl.chunks) {
+            chunk_header *h = pl.chunks;
+            pl.chunks = h->next;
+            m_upstream->deallocate(h, h->bytes, h->alignment);
+        }
+        pl.free_list = nullptr;
+        pl.next_blocks = 0;
+    }
+
+    while (m_oversized) {
+        oversized_header *h = m_oversized;
+        m_oversized = h->next;
+        m_upstream->deallocate(h, h->bytes, h->alignment);
+    }
+}
+
+size_t polyalloc::unsynchronized_pool_resource::pool_index(
+    size_t bytes,
+    size_t alignment) const
+{
+    if (alignment > max_pool_alignment)
+        return m_npools;
+
+    size_t n = bytes < alignment ? alignment : bytes;
+    size_t index = 0;
+    for (size_t block = smallest_block; block < n; block <<= 1)
+        if (++index == m_npools)
+            break;
+    return index;
+}
+
+void polyalloc::unsynchronized_pool_resource::replenish(size_t index)
+{
+    // Start with about a page worth of blocks and double from there
+    static const size_t initial_chunk = 4096;
+
+    pool& pl = m_pools[index];
+    size_t block = smallest_block << index;
+    size_t alignment = block < max_pool_alignment ? block : max_pool_alignment;
+
+    size_t blocks = pl.next_blocks;
+    if (0 == blocks)
+        blocks = block < initial_chunk ? initial_chunk / block : 1;
+    if (blocks > m_options.max_blocks_per_chunk)
+        blocks = m_options.max_blocks_per_chunk;
+
+    size_t header = round_up(sizeof(chunk_header), alignment);
+    size_t bytes = header + blocks * block;
+
+    chunk_header *h =
+        static_cast<chunk_header*>(m_upstream->allocate(bytes, alignment));
+    h->next = pl.chunks;
+    h->bytes = bytes;
+    h->alignment = alignment;
+    pl.chunks = h;
+
+    char *p = reinterpret_cast<char*>(h) + header;
+    for (size_t i = 0; i < blocks; ++i, p += block) {
+        *reinterpret_cast<void**>(p) = pl.free_list;
+        pl.free_list = p;
+    }
+
+    pl.next_blocks = blocks * 2;
+}
+
+void *polyalloc::unsynchronized_pool_resource::allocate(size_t bytes,
+                                                        size_t alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+    assert((alignment & (alignment - 1)) == 0);
+
+    size_t index = pool_index(bytes, alignment);
+
+    if (index == m_npools) {
+        if (alignment < alignof(oversized_header))
+            alignment = alignof(oversized_header);
+        size_t header = round_up(sizeof(oversized_header), alignment);
+
+        oversized_header *h = static_cast<oversized_header*>(
+            m_upstream->allocate(header + bytes, alignment));
+        h->prev = nullptr;
+        h->next = m_oversized;
+        h->bytes = header + bytes;
+        h->alignment = alignment;
+        if (m_oversized)
+            m_oversized->prev = h;
+        m_oversized = h;
+
+        return reinterpret_cast<char*>(h) + header;
+    }
+
+    pool& pl = m_pools[index];
+    if (!pl.free_list)
+        replenish(index);
+
+    void *p = pl.free_list;
+    pl.free_list = *static_cast<void**>(p);
+    return p;
+}
+
+void polyalloc::unsynchronized_pool_resource::deallocate(void   *p,
+                                                         size_t  bytes,
+                                                         size_t  alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+
+    size_t index = pool_index(bytes, alignment);
+
+    if (index == m_npools) {
+        if (alignment < alignof(oversized_header))
+            alignment = alignof(oversized_header);
+        size_t header = round_up(sizeof(oversized_header), alignment);
+
+        oversized_header *h = reinterpret_cast<oversized_header*>(
+            static_cast<char*>(p) - header);
+        if (h->prev)
+            h->prev->next = h->next;
+        else
+            m_oversized = h->next;
+        if (h->next)
+            h->next->prev = h->prev;
+
+        m_upstream->deallocate(h, h->bytes, h->alignment);
+        return;
+    }
+
+    pool& pl = m_pools[index];
+    *static_cast<void**>(p) = pl.free_list;
+    pl.free_list = p;
+}
+
+bool polyalloc::unsynchronized_pool_resource::is_equal(
+    const memory_resource& other) const
+{
+    return this == &other;
+}
+
+struct polyalloc::synchronized_pool_resource::thread_cache
+{
+    struct free_list
+    {
+        void   *head;
+        size_t  count;
+    };
+
+    // Null once the resource is gone
+    synchronized_pool_resource *owner;
+    thread_cache               *next;
+    free_list                   lists[unsynchronized_pool_resource::max_pools];
+};
+
+// The caches of the current thread, one for each resource it has used
+struct polyalloc::synchronized_pool_resource::local_caches
+{
+    struct entry
+    {
+        size_t        id;
+        thread_cache *cache;
+    };
+
+    size_t        last_id = 0;
+    thread_cache *last = nullptr;
+    vector<entry> entries;
+
+    thread_cache *find(size_t id)
+    {
+        if (id == last_id)
+            return last;
+
+        for (entry& e : entries)
+            if (e.id == id) {
+                last_id = id;
+                last = e.cache;
+                return last;
+            }
+
+        return nullptr;
+    }
+
+    ~local_caches();
+};
+
+thread_local polyalloc::synchronized_pool_resource::local_caches
+polyalloc::synchronized_pool_resource::s_local_caches;
+
+namespace {
+
+// Guards the links between the resources and the caches of the threads,
+// which are only touched when a thread meets a resource for the first
+// time, when a thread exits, and when a resource is destroyed.
+mutex s_caches_mutex;
+
+atomic<size_t> s_next_resource_id(1);
+
+} // end unnamed namespace
+
+polyalloc::synchronized_pool_resource::synchronized_pool_resource()
+    : synchronized_pool_resource(pool_options())
+{
+}
+
+polyalloc::synchronized_pool_resource::synchronized_pool_resource(
+    memory_resource *upstream)
+    : synchronized_pool_resource(pool_options(), upstream)
+{
+}
+
+polyalloc::synchronized_pool_resource::synchronized_pool_resource(
+    const pool_options&  opts,
+    memory_resource     *upstream)
+    : m_shared(opts, upstream)
+    , m_caches(nullptr)
+    , m_cache_limit(default_cache_limit)
+    , m_id(s_next_resource_id++)
+{
+}
+
+polyalloc::synchronized_pool_resource::~synchronized_pool_resource()
+{
+    lock_guard<mutex> guard(s_caches_mutex);
+
+    // The threads still holding the caches will free them on exit
+    for (thread_cache *c = m_caches; c; c = c->next)
+        c->owner = nullptr;
+    m_caches = nullptr;
+
+    m_shared.release();
+}
+
+void polyalloc::synchronized_pool_resource::release()
+{
+    lock_guard<mutex> guard(s_caches_mutex);
+    lock_guard<mutex> guard2(m_mutex);
+
+    for (thread_cache *c = m_caches; c; c = c->next)
+        for (auto& l : c->lists) {
+            l.head = nullptr;
+            l.count = 0;
+        }
+
+    m_shared.release();
+}
+
+polyalloc::synchronized_pool_resource::thread_cache *
+polyalloc::synchronized_pool_resource::local_cache()
+{
+    local_caches& lc = s_local_caches;
+    if (thread_cache *c = lc.find(m_id))
+        return c;
+
+    thread_cache *c = new thread_cache();
+    c->owner = this;
+
+    {
+        lock_guard<mutex> guard(s_caches_mutex);
+
+        c->next = m_caches;
+        m_caches = c;
+
+        // Forget the caches of the resources already destroyed
+        auto it = lc.entries.begin();
+        while (it != lc.entries.end())
+            if (it->cache->owner == nullptr) {
+                delete it->cache;
+                it = lc.entries.erase(it);
+            } else
+                ++it;
+    }
+
+    lc.entries.push_back({ m_id, c });
+    lc.last_id = m_id;
+    lc.last = c;
+    return c;
+}
+
+void polyalloc::synchronized_pool_resource::drain(thread_cache *c,
+                                                  size_t        index,
+                                                  size_t        keep)
+{
+    size_t block = unsynchronized_pool_resource::smallest_block << index;
+    auto& l = c->lists[index];
+
+    lock_guard<mutex> guard(m_mutex);
+
+    while (l.count > keep) {
+        void *p = l.head;
+        l.head = *static_cast<void**>(p);
+        --l.count;
+        m_shared.deallocate(p, block, 1);
+    }
+}
+
+void *polyalloc::synchronized_pool_resource::allocate(size_t bytes,
+                                                      size_t alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+    size_t index = m_shared.pool_index(bytes, alignment);
+
+    if (index == m_shared.m_npools) {
+        lock_guard<mutex> guard(m_mutex);
+        return m_shared.allocate(bytes, alignment);
+    }
+
+    thread_cache *c = local_cache();
+    auto& l = c->lists[index];
+
+    if (!l.head) {
+        // Refill half of the cache at once
+        size_t block = unsynchronized_pool_resource::smallest_block << index;
+        size_t n = m_cache_limit / 2;
+
+        lock_guard<mutex> guard(m_mutex);
+
+        for (size_t i = 0; i < n; ++i) {
+            void *p = m_shared.allocate(block, 1);
+            *static_cast<void**>(p) = l.head;
+            l.head = p;
+            ++l.count;
+        }
+    }
+
+    void *p = l.head;
+    l.head = *static_cast<void**>(p);
+    --l.count;
+    return p;
+}
+
+void polyalloc::synchronized_pool_resource::deallocate(void   *p,
+                                                       size_t  bytes,
+                                                       size_t  alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+    size_t index = m_shared.pool_index(bytes, alignment);
+
+    if (index == m_shared.m_npools) {
+        lock_guard<mutex> guard(m_mutex);
+        m_shared.deallocate(p, bytes, alignment);
+        return;
+    }
+
+    thread_cache *c = local_cache();
+    auto& l = c->lists[index];
+
+    *static_cast<void**>(p) = l.head;
+    l.head = p;
+    ++l.count;
+
+    if (l.count > m_cache_limit)
+        drain(c, index, m_cache_limit / 2);
+}
+
+bool polyalloc::synchronized_pool_resource::is_equal(
+    const memory_resource& other) const
+{
+    return this == &other;
+}
+
+polyalloc::synchronized_pool_resource::local_caches::~local_caches()
+{
+    lock_guard<mutex> guard(s_caches_mutex);
+
+    for (entry& e : entries) {
+        thread_cache *c = e.cache;
+
+        if (auto r = c->owner) {
+            for (size_t i = 0; i < r->m_shared.m_npools; ++i)
+                r->drain(c, i, 0);
+
+            thread_cache **pp = &r->m_caches;
+            while (*pp != c)
+                pp = &(*pp)->next;
+            *pp = c->next;
+        }
+
+        delete c;
+    }
+}
+
+namespace {
+
+size_t log2_ceil(size_t n)
+{
+    size_t i = 0;
+    while (i < sizeof(size_t) * CHAR_BIT && (size_t(1) << i) < n)
+        ++i;
+    return i;
+}
+
+} // end unnamed namespace
+
+const polyalloc::stats_resource::counters&
+polyalloc::stats_resource::snapshot_type::for_alignment(
+    size_t alignment) const
+{
+    static const counters none = {};
+
+    size_t i = log2_ceil(alignment);
+    if (i >= alignment_classes)
+        i = alignment_classes - 1;
+
+    if (by_alignment[i].alignment == alignment)
+        return by_alignment[i];
+    else
+        return none;
+}
+
+polyalloc::stats_resource::stats_resource()
+    : stats_resource(nullptr)
+{
+}
+
+polyalloc::stats_resource::stats_resource(memory_resource *upstream)
+    : m_upstream(upstream ? upstream : get_default_resource())
+    , m_stats()
+{
+}
+
+polyalloc::stats_resource::snapshot_type
+polyalloc::stats_resource::snapshot() const
+{
+    lock_guard<mutex> guard(m_mutex);
+    return m_stats;
+}
+
+void polyalloc::stats_resource::reset()
+{
+    lock_guard<mutex> guard(m_mutex);
+
+    auto clear = [](counters& c)
+    {
+        size_t alignment = c.alignment;
+        size_t in_use = c.bytes_in_use;
+        c = counters();
+        c.alignment = alignment;
+        c.bytes_in_use = in_use;
+        c.peak_bytes_in_use = in_use;
+    };
+
+    clear(m_stats.total);
+    for (auto& c : m_stats.by_alignment)
+        clear(c);
+}
+
+void *polyalloc::stats_resource::allocate(size_t bytes, size_t alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+    void *p = m_upstream->allocate(bytes, alignment);
+
+    // the largest alignments go to the overflow bucket
+    size_t i = log2_ceil(alignment);
+    if (i >= alignment_classes)
+        i = alignment_classes - 1;
+    size_t bucket = log2_ceil(bytes);
+    if (bucket >= histogram_buckets)
+        bucket = histogram_buckets - 1;
+
+    lock_guard<mutex> guard(m_mutex);
+
+    for (counters *c : { &m_stats.total, &m_stats.by_alignment[i] }) {
+        ++c->allocations;
+        c->bytes_allocated += bytes;
+        c->bytes_in_use += bytes;
+        if (c->peak_bytes_in_use < c->bytes_in_use)
+            c->peak_bytes_in_use = c->bytes_in_use;
+        ++c->histogram[bucket];
+    }
+    m_stats.by_alignment[i].alignment = alignment;
+
+    return p;
+}
+
+void polyalloc::stats_resource::deallocate(void   *p,
+                                           size_t  bytes,
+                                           size_t  alignment)
+{
+    alignment = natural_alignment(bytes, alignment);
+    m_upstream->deallocate(p, bytes, alignment);
+
+    size_t i = log2_ceil(alignment);
+    if (i >= alignment_classes)
+        i = alignment_classes - 1;
+
+    lock_guard<mutex> guard(m_mutex);
+
+    for (counters *c : { &m_stats.total, &m_stats.by_alignment[i] }) {
+        ++c->deallocations;
+        c->bytes_deallocated += bytes;
+        c->bytes_in_use -= bytes;
+    }
+}
+
+bool polyalloc::stats_resource::is_equal(const memory_resource& other) const
+{
+    return this == &other;
+}
+
+namespace {
+
+size_t system_huge_page_size()
+{
+    size_t n = 2 * 1024 * 1024;
+
+#if defined(__linux__)
+    if (FILE *fp = fopen("/proc/meminfo", "r")) {
+        char line[128];
+        unsigned long kb;
+        while (fgets(line, sizeof(line), fp))
+            if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+                n = size_t(kb) * 1024;
+                break;
+            }
+        fclose(fp);
+    }
+#endif
+
+    return n;
+}
+
+} // end unnamed namespace
+
+polyalloc::huge_page_resource::huge_page_resource()
+    : huge_page_resource(size_t(0))
+{
+}
+
+polyalloc::huge_page_resource::huge_page_resource(memory_resource *upstream)
+    : huge_page_resource(size_t(0), upstream)
+{
+}
+
+polyalloc::huge_page_resource::huge_page_resource(size_t           threshold,
+                                                  memory_resource *upstream)
+    : m_upstream(upstream ? upstream : get_default_resource())
+{
+    static const size_t page_size = system_huge_page_size();
+
+    m_page_size = page_size;
+    m_threshold = threshold ? threshold : page_size;
+}
+
+void *polyalloc::huge_page_resource::allocate(size_t bytes, size_t alignment)
+{
+#if !defined(_WIN32)
+    if (bytes >= m_threshold && alignment <= m_page_size) {
+        size_t len = round_up(bytes, m_page_size);
+        void *p;
+
+#if defined(MAP_HUGETLB)
+        p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return p;
+#endif
+
+        // Over-map by a huge page to trim down to an aligned one
+        p = mmap(nullptr, len + m_page_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw bad_alloc();
+
+        char *bg = static_cast<char*>(p);
+        char *aligned = bg + ((0 - size_t(bg)) & (m_page_size - 1));
+        if (aligned != bg)
+            munmap(bg, size_t(aligned - bg));
+        if (size_t tail = m_page_size - size_t(aligned - bg))
+            munmap(aligned + len, tail);
+
+#if defined(MADV_HUGEPAGE)
+        (void)madvise(aligned, len, MADV_HUGEPAGE);
+#endif
+        return aligned;
+    }
+#endif
+
+    return m_upstream->allocate(bytes, alignment);
+}
+
+void polyalloc::huge_page_resource::deallocate(void   *p,
+                                               size_t  bytes,
+                                               size_t  alignment)
+{
+#if !defined(_WIN32)
+    if (bytes >= m_threshold && alignment <= m_page_size) {
+        munmap(p, round_up(bytes, m_page_size));
+        return;
+    }
+#endif
+
+    m_upstream->deallocate(p, bytes, alignment);
+}
+
+bool polyalloc::huge_page_resource::is_equal(
+    const memory_resource& other) const
+{
+    return this == &other;
+}
+
 END_NAMESPACE_XSTD
 
 // end polymorphic_allocator.cpp
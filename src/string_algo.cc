@@ -0,0 +1,330 @@
+/*-
+ * Copyright (c) 2016 Zhihao Yuan.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "string_algo.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) || \
+    defined(_M_X64)
+#define STDEX_HAS_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define STDEX_HAS_AVX2
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace stdex
+{
+
+#if defined(STDEX_HAS_SSE2)
+
+static
+int highest_bit(unsigned m)
+{
+#if defined(_MSC_VER)
+	unsigned long i;
+	_BitScanReverse(&i, m);
+	return int(i);
+#else
+	return 31 - __builtin_clz(m);
+#endif
+}
+
+template <size_t Width>
+struct lanes;
+
+template <>
+struct lanes<1>
+{
+	static __m128i splat(int c)
+	{
+		return _mm_set1_epi8(char(c));
+	}
+
+	static __m128i equal(__m128i a, __m128i b)
+	{
+		return _mm_cmpeq_epi8(a, b);
+	}
+};
+
+template <>
+struct lanes<2>
+{
+	static __m128i splat(int c)
+	{
+		return _mm_set1_epi16(short(c));
+	}
+
+	static __m128i equal(__m128i a, __m128i b)
+	{
+		return _mm_cmpeq_epi16(a, b);
+	}
+};
+
+template <>
+struct lanes<4>
+{
+	static __m128i splat(int c)
+	{
+		return _mm_set1_epi32(c);
+	}
+
+	static __m128i equal(__m128i a, __m128i b)
+	{
+		return _mm_cmpeq_epi32(a, b);
+	}
+};
+
+template <typename CharT>
+static
+CharT const* rfind_sse2(CharT const* s, size_t n, CharT c)
+{
+	using L = lanes<sizeof(CharT)>;
+	constexpr size_t k = 16 / sizeof(CharT);
+
+	auto e = s + n;
+	auto needle = L::splat(int(c));
+
+	while (size_t(e - s) >= k)
+	{
+		e -= k;
+		auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(e));
+		auto m = unsigned(_mm_movemask_epi8(L::equal(v, needle)));
+		if (m != 0)
+			return e + highest_bit(m) / int(sizeof(CharT)) + 1;
+	}
+
+	return rfind<CharT>(s, size_t(e - s), c);
+}
+
+#if defined(STDEX_HAS_AVX2)
+
+template <size_t Width>
+struct wide_lanes;
+
+template <>
+struct wide_lanes<1>
+{
+	__attribute__((target("avx2")))
+	static __m256i splat(int c)
+	{
+		return _mm256_set1_epi8(char(c));
+	}
+
+	__attribute__((target("avx2")))
+	static __m256i equal(__m256i a, __m256i b)
+	{
+		return _mm256_cmpeq_epi8(a, b);
+	}
+};
+
+template <>
+struct wide_lanes<2>
+{
+	__attribute__((target("avx2")))
+	static __m256i splat(int c)
+	{
+		return _mm256_set1_epi16(short(c));
+	}
+
+	__attribute__((target("avx2")))
+	static __m256i equal(__m256i a, __m256i b)
+	{
+		return _mm256_cmpeq_epi16(a, b);
+	}
+};
+
+template <>
+struct wide_lanes<4>
+{
+	__attribute__((target("avx2")))
+	static __m256i splat(int c)
+	{
+		return _mm256_set1_epi32(c);
+	}
+
+	__attribute__((target("avx2")))
+	static __m256i equal(__m256i a, __m256i b)
+	{
+		return _mm256_cmpeq_epi32(a, b);
+	}
+};
+
+template <typename CharT>
+__attribute__((target("avx2")))
+static
+CharT const* rfind_avx2(CharT const* s, size_t n, CharT c)
+{
+	using L = wide_lanes<sizeof(CharT)>;
+	constexpr size_t k = 32 / sizeof(CharT);
+
+	auto e = s + n;
+	auto needle = L::splat(int(c));
+
+	while (size_t(e - s) >= k)
+	{
+		e -= k;
+		auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(e));
+		auto m = unsigned(_mm256_movemask_epi8(L::equal(v, needle)));
+		if (m != 0)
+			return e + highest_bit(m) / int(sizeof(CharT)) + 1;
+	}
+
+	// fewer than 32 bytes left
+	return rfind_sse2(s, size_t(e - s), c);
+}
+
+#endif
+
+template <typename CharT>
+static
+auto pick_rfind()
+{
+#if defined(STDEX_HAS_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return &rfind_avx2<CharT>;
+#endif
+	return &rfind_sse2<CharT>;
+}
+
+char const* rfind(char const* s, size_t n, char c)
+{
+	static auto const fn = pick_rfind<char>();
+	return fn(s, n, c);
+}
+
+wchar_t const* rfind(wchar_t const* s, size_t n, wchar_t c)
+{
+	static auto const fn = pick_rfind<wchar_t>();
+	return fn(s, n, c);
+}
+
+template <size_t Width>
+struct narrowing;
+
+template <>
+struct narrowing<2>
+{
+	// 16 characters from s as bytes; nonzero in mask unless ASCII
+	template <typename CharT>
+	static __m128i load(CharT const* s, __m128i& mask)
+	{
+		auto p = reinterpret_cast<__m128i const*>(s);
+		auto a = _mm_loadu_si128(p);
+		auto b = _mm_loadu_si128(p + 1);
+		auto high = _mm_set1_epi16(short(~0x7f));
+		mask = _mm_and_si128(_mm_or_si128(a, b), high);
+		return _mm_packus_epi16(a, b);
+	}
+};
+
+template <>
+struct narrowing<4>
+{
+	template <typename CharT>
+	static __m128i load(CharT const* s, __m128i& mask)
+	{
+		auto p = reinterpret_cast<__m128i const*>(s);
+		auto a = _mm_loadu_si128(p);
+		auto b = _mm_loadu_si128(p + 1);
+		auto c = _mm_loadu_si128(p + 2);
+		auto d = _mm_loadu_si128(p + 3);
+		auto high = _mm_set1_epi32(~0x7f);
+		mask = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b),
+		    _mm_or_si128(c, d)), high);
+		return _mm_packus_epi16(_mm_packs_epi32(a, b),
+		    _mm_packs_epi32(c, d));
+	}
+};
+
+template <typename CharT>
+static
+size_t narrow_ascii_sse2(char* buf, CharT const* s, size_t n)
+{
+	using N = narrowing<sizeof(CharT)>;
+
+	size_t i = 0;
+	auto zero = _mm_setzero_si128();
+	for (; n - i >= 16; i += 16)
+	{
+		__m128i mask;
+		auto v = N::load(s + i, mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(mask, zero)) != 0xffff)
+			break;
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(buf + i), v);
+	}
+
+	return i + narrow_ascii<CharT>(buf + i, s + i, n - i);
+}
+
+size_t narrow_ascii(char* buf, wchar_t const* s, size_t n)
+{
+	return narrow_ascii_sse2(buf, s, n);
+}
+
+size_t narrow_ascii(char* buf, char16_t const* s, size_t n)
+{
+	return narrow_ascii_sse2(buf, s, n);
+}
+
+size_t narrow_ascii(char* buf, char32_t const* s, size_t n)
+{
+	return narrow_ascii_sse2(buf, s, n);
+}
+
+#else
+
+char const* rfind(char const* s, size_t n, char c)
+{
+	return rfind<char>(s, n, c);
+}
+
+wchar_t const* rfind(wchar_t const* s, size_t n, wchar_t c)
+{
+	return rfind<wchar_t>(s, n, c);
+}
+
+size_t narrow_ascii(char* buf, wchar_t const* s, size_t n)
+{
+	return narrow_ascii<wchar_t>(buf, s, n);
+}
+
+size_t narrow_ascii(char* buf, char16_t const* s, size_t n)
+{
+	return narrow_ascii<char16_t>(buf, s, n);
+}
+
+size_t narrow_ascii(char* buf, char32_t const* s, size_t n)
+{
+	return narrow_ascii<char32_t>(buf, s, n);
+}
+
+#endif
+
+}
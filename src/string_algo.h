@@ -28,6 +28,8 @@
 
 #include <algorithm>
 #include <iterator>
+#include <string.h>
+#include <wchar.h>
 
 namespace stdex
 {
@@ -48,6 +50,7 @@ auto as_bytes(CharT* s) -> R
 	return reinterpret_cast<R>(s);
 }
 
+// returns the position after the last c, or s if there is none
 template <typename CharT>
 inline
 CharT const* rfind(CharT const* s, size_t n, CharT c)
@@ -57,6 +60,42 @@ CharT const* rfind(CharT const* s, size_t n, CharT c)
 	return it.base();
 }
 
+// vectorized with the best instructions the CPU offers
+char const* rfind(char const* s, size_t n, char c);
+wchar_t const* rfind(wchar_t const* s, size_t n, wchar_t c);
+
+// copies the leading characters of s below 0x80, at most n of them,
+// into buf as bytes; returns how many
+template <typename CharT>
+inline
+size_t narrow_ascii(char* buf, CharT const* s, size_t n)
+{
+	size_t i = 0;
+	for (; i < n and unsigned(s[i]) < 0x80; ++i)
+		buf[i] = char(s[i]);
+
+	return i;
+}
+
+// vectorized with SSE2
+size_t narrow_ascii(char* buf, wchar_t const* s, size_t n);
+size_t narrow_ascii(char* buf, char16_t const* s, size_t n);
+size_t narrow_ascii(char* buf, char32_t const* s, size_t n);
+
+// returns the position of the first c, or nullptr if there is none;
+// memchr and wmemchr are already vectorized in the C libraries
+inline
+char const* find(char const* s, size_t n, char c)
+{
+	return static_cast<char const*>(memchr(s, c, n));
+}
+
+inline
+wchar_t const* find(wchar_t const* s, size_t n, wchar_t c)
+{
+	return wmemchr(s, c, n);
+}
+
 }
 
 #endif
@@ -182,6 +182,11 @@ void operator delete(void *p) noexcept
     countedDeallocate(p, &newDeleteCounters);
 }
 
+void operator delete(void *p, std::size_t nbytes) noexcept
+{
+    countedDeallocate(p, nbytes, &newDeleteCounters);
+}
+
 class TestResource : public XSTD::polyalloc::memory_resource
 {
     AllocCounters m_counters;
@@ -598,6 +603,9 @@ int main(int argc, char *argv[])
             ASSERT(p);
             ASSERT(newDeleteCounters.blocks_outstanding() == expBlocks);
             ASSERT(newDeleteCounters.bytes_outstanding() == expBytes);
+
+            r->deallocate(p, 5);
+            ASSERT(newDeleteCounters.blocks_outstanding() == expBlocks - 1);
         }
 
         XSTD::polyalloc::set_default_resource(&dfltTestRsrc);
@@ -882,6 +890,282 @@ int main(int argc, char *argv[])
 
       } if (test != 0) break;
 
+      case 2:
+      {
+        // --------------------------------------------------------------------
+        // BUFFER POOL RESOURCE
+        // --------------------------------------------------------------------
+
+        std::cout << "\nBUFFER POOL RESOURCE"
+                  << "\n====================" << std::endl;
+
+        TestResource x;
+        AllocCounters &xc = x.counters();
+
+        {
+            buffer_pool_resource r(2, 64, 8192, &x);
+            ASSERT(r.upstream_resource() == &x);
+
+            // Blocks of a cached size are reused
+            void *p1 = r.allocate(4096, 2);
+            void *p2 = r.allocate(4096, 2);
+            ASSERT(2 == xc.blocks_outstanding());
+            r.deallocate(p1, 4096, 2);
+            r.deallocate(p2, 4096, 2);
+            ASSERT(2 == xc.blocks_outstanding());
+            ASSERT(2 == r.cached_blocks());
+
+            void *p3 = r.allocate(4096, 2);
+            ASSERT(p3 == p2);
+            ASSERT(1 == r.cached_blocks());
+            ASSERT(2 == xc.blocks_outstanding());
+
+            // Different alignment means a different bin
+            void *p4 = r.allocate(4096, 8);
+            ASSERT(3 == xc.blocks_outstanding());
+            r.deallocate(p4, 4096, 8);
+            ASSERT(2 == r.cached_blocks());
+
+            // No more than 'max_blocks_per_size' per bin
+            void *p5 = r.allocate(4096, 8);
+            void *p6 = r.allocate(4096, 8);
+            void *p7 = r.allocate(4096, 8);
+            r.deallocate(p5, 4096, 8);
+            r.deallocate(p6, 4096, 8);
+            r.deallocate(p7, 4096, 8);
+            ASSERT(3 == r.cached_blocks());
+            ASSERT(4 == xc.blocks_outstanding());
+
+            // Too small or too large blocks are not cached
+            void *p8 = r.allocate(16);
+            void *p9 = r.allocate(16384);
+            r.deallocate(p8, 16);
+            r.deallocate(p9, 16384);
+            ASSERT(3 == r.cached_blocks());
+            ASSERT(4 == xc.blocks_outstanding());
+
+            r.deallocate(p3, 4096, 2);
+            r.release();
+            ASSERT(0 == r.cached_blocks());
+            ASSERT(0 == xc.blocks_outstanding());
+
+            // Destruction releases the cached blocks
+            r.deallocate(r.allocate(1024), 1024);
+            ASSERT(1 == xc.blocks_outstanding());
+        }
+        ASSERT(0 == xc.blocks_outstanding());
+
+      } if (test != 0) break;
+
+      case 3:
+      {
+        // --------------------------------------------------------------------
+        // MONOTONIC BUFFER RESOURCE
+        // --------------------------------------------------------------------
+
+        std::cout << "\nMONOTONIC BUFFER RESOURCE"
+                  << "\n=========================" << std::endl;
+
+        TestResource x;
+        AllocCounters &xc = x.counters();
+
+        {
+            // Served from the initial buffer first
+            alignas(16) char buffer[256];
+            monotonic_buffer_resource r(buffer, sizeof(buffer), &x);
+            ASSERT(r.upstream_resource() == &x);
+
+            char *p1 = static_cast<char*>(r.allocate(10, 1));
+            char *p2 = static_cast<char*>(r.allocate(16, 16));
+            ASSERT(p1 == buffer);
+            ASSERT(p2 == buffer + 16);
+            ASSERT(0 == xc.blocks_outstanding());
+
+            // Deallocation is a no-op
+            r.deallocate(p2, 16, 16);
+            char *p3 = static_cast<char*>(r.allocate(8, 8));
+            ASSERT(p3 == buffer + 32);
+
+            // Then from the upstream
+            void *p4 = r.allocate(300, 8);
+            ASSERT(p4);
+            ASSERT(0 == (size_t(p4) & 7));
+            ASSERT(1 == xc.blocks_outstanding());
+            void *p5 = r.allocate(8, 64);
+            ASSERT(0 == (size_t(p5) & 63));
+
+            for (int i = 0; i < 100; ++i)
+                std::memset(r.allocate(100), 0, 100);
+            ASSERT(1 < xc.blocks_outstanding());
+
+            // Start over from the initial buffer
+            r.release();
+            ASSERT(0 == xc.blocks_outstanding());
+            ASSERT(buffer == r.allocate(10, 1));
+        }
+
+        {
+            monotonic_buffer_resource r(&x);
+            r.allocate(5000);
+            ASSERT(1 == xc.blocks_outstanding());
+        }
+        ASSERT(0 == xc.blocks_outstanding());
+
+      } if (test != 0) break;
+
+      case 4:
+      {
+        // --------------------------------------------------------------------
+        // UNSYNCHRONIZED POOL RESOURCE
+        // --------------------------------------------------------------------
+
+        std::cout << "\nUNSYNCHRONIZED POOL RESOURCE"
+                  << "\n============================" << std::endl;
+
+        TestResource x;
+        AllocCounters &xc = x.counters();
+
+        {
+            pool_options opts;
+            opts.max_blocks_per_chunk = 4;
+            opts.largest_required_pool_block = 1000;
+
+            unsynchronized_pool_resource r(opts, &x);
+            ASSERT(r.upstream_resource() == &x);
+            ASSERT(4 == r.options().max_blocks_per_chunk);
+            ASSERT(1024 == r.options().largest_required_pool_block);
+
+            // One chunk holds 4 blocks of 24 -> 32 bytes
+            void *p[5];
+            for (int i = 0; i < 4; ++i) {
+                p[i] = r.allocate(24, 8);
+                ASSERT(0 == (size_t(p[i]) & 7));
+            }
+            ASSERT(1 == xc.blocks_outstanding());
+            p[4] = r.allocate(24, 8);
+            ASSERT(2 == xc.blocks_outstanding());
+
+            // Blocks are recycled within the pool
+            r.deallocate(p[2], 24, 8);
+            ASSERT(p[2] == r.allocate(30, 8));
+            ASSERT(2 == xc.blocks_outstanding());
+
+            // Different size class, different chunk
+            void *q = r.allocate(100, 16);
+            ASSERT(3 == xc.blocks_outstanding());
+            r.deallocate(q, 100, 16);
+
+            // Oversized blocks and over-aligned blocks go upstream
+            void *big = r.allocate(4096, 2);
+            ASSERT(4 == xc.blocks_outstanding());
+            void *aligned = r.allocate(64, 64);
+            ASSERT(5 == xc.blocks_outstanding());
+            r.deallocate(big, 4096, 2);
+            ASSERT(4 == xc.blocks_outstanding());
+            r.deallocate(aligned, 64, 64);
+            ASSERT(3 == xc.blocks_outstanding());
+            r.allocate(5000);
+
+            r.release();
+            ASSERT(0 == xc.blocks_outstanding());
+
+            void *p0 = r.allocate(8);
+            r.deallocate(p0, 8);
+            ASSERT(1 == xc.blocks_outstanding());
+        }
+        ASSERT(0 == xc.blocks_outstanding());
+
+      } if (test != 0) break;
+
+      case 5:
+      {
+        // --------------------------------------------------------------------
+        // SYNCHRONIZED POOL RESOURCE
+        // --------------------------------------------------------------------
+
+        std::cout << "\nSYNCHRONIZED POOL RESOURCE"
+                  << "\n==========================" << std::endl;
+
+        TestResource x;
+        AllocCounters &xc = x.counters();
+
+        {
+            synchronized_pool_resource r(&x);
+            ASSERT(r.upstream_resource() == &x);
+
+            // Blocks are recycled through the thread cache
+            void *p1 = r.allocate(100, 8);
+            r.deallocate(p1, 100, 8);
+            ASSERT(p1 == r.allocate(128, 8));
+            r.deallocate(p1, 128, 8);
+            int chunks = xc.blocks_outstanding();
+            ASSERT(0 < chunks);
+
+            // Oversized blocks go upstream
+            int expBlocks = xc.blocks_outstanding();
+            void *big = r.allocate(1024 * 1024, 2);
+            ASSERT(expBlocks + 1 == xc.blocks_outstanding());
+            r.deallocate(big, 1024 * 1024, 2);
+            ASSERT(expBlocks == xc.blocks_outstanding());
+
+            r.release();
+            ASSERT(0 == xc.blocks_outstanding());
+
+            // Usable as the default resource
+            memory_resource *prev = set_default_resource(&r);
+            POLYALLOC<int> a;
+            ASSERT(a.resource() == &r);
+            a.deallocate(a.allocate(10), 10);
+            ASSERT(&r == set_default_resource(prev));
+        }
+        ASSERT(0 == xc.blocks_outstanding());
+
+      } if (test != 0) break;
+
+      case 6:
+      {
+        // --------------------------------------------------------------------
+        // OVER-ALIGNED ALLOCATIONS
+        // --------------------------------------------------------------------
+
+        std::cout << "\nOVER-ALIGNED ALLOCATIONS"
+                  << "\n========================" << std::endl;
+
+        newDeleteCounters.clear();
+
+        {
+            memory_resource *r = new_delete_resource_singleton();
+
+            for (size_t align = 32; align <= 16384; align *= 2)
+                for (size_t bytes : { size_t(1), size_t(100), align - 1,
+                                      align, align + 1, 3 * align + 7 }) {
+                    char *p = static_cast<char*>(r->allocate(bytes, align));
+                    LOOP2_ASSERT(align, bytes, 0 == (size_t(p) & (align-1)));
+
+                    // The whole block is writable without clobbering the
+                    // bookkeeping
+                    std::memset(p, 0xa5, bytes);
+                    r->deallocate(p, bytes, align);
+                }
+
+            ASSERT(0 == newDeleteCounters.blocks_outstanding());
+            ASSERT(0 == newDeleteCounters.bytes_outstanding());
+        }
+
+        {
+            struct alignas(256) Page { char x[256]; };
+
+            POLYALLOC<Page> a(new_delete_resource_singleton());
+            Page *p = a.allocate(3);
+            ASSERT(0 == (size_t(p) & 255));
+            std::memset(p, 0, 3 * sizeof(Page));
+            a.deallocate(p, 3);
+
+            ASSERT(0 == newDeleteCounters.blocks_outstanding());
+        }
+
+      } if (test != 0) break;
+
       break;
 
       default: {
@@ -4,6 +4,11 @@
 #include "catch.hpp"
 #include "test_data.h"
 
+#include <algorithm>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#endif
+
 using stdex::file;
 using stdex::open_file;
 using stdex::whence;
@@ -117,6 +122,123 @@ TEST_CASE("open local files")
 	::remove(fn.data());
 }
 
+TEST_CASE("files allocated from an arena")
+{
+	namespace pmr = xstd::polyalloc;
+
+	auto fn = random_filename("fileio_t_");
+	alignas(16) char buf[256];
+
+	{
+		pmr::monotonic_buffer_resource arena(buf, sizeof(buf));
+		auto f = stdex::allocate_file(&arena, fn, "w");
+
+		f.print("Aozora Jumping Heart");
+	}
+
+	{
+		pmr::unsynchronized_pool_resource pool;
+		auto f = stdex::allocate_file(&pool, fn, "a");
+
+		f.print('\n');
+	}
+
+	{
+		auto f = open_file(fn, "r");
+		char s[40];
+		auto r = f.read(s, sizeof(s));
+
+		REQUIRE(stdex::string_view(s, r.count()) ==
+		    "Aozora Jumping Heart\n");
+	}
+
+	::remove(fn.data());
+}
+
+TEST_CASE("file metadata")
+{
+	auto fn = random_filename("fileio_t_");
+
+	{
+		auto f = open_file(fn, "w");
+
+		f.print("Daisuki da yo");
+	}
+
+	{
+		auto f = open_file(fn, "r");
+		auto md = f.stat();
+
+		REQUIRE(md.type == stdex::file_type::regular);
+		REQUIRE(md.size == 13);
+		REQUIRE_FALSE(md.tty);
+		REQUIRE_FALSE(f.isatty());
+
+		// a snapshot, not refreshed
+		auto g = open_file(fn, "a");
+		g.print("!");
+		g.flush();
+
+		REQUIRE(f.stat().size == 13);
+	}
+
+	REQUIRE(stdex::slurp(fn) == "Daisuki da yo!");
+
+	::remove(fn.data());
+
+	std::error_code ec;
+	auto s = stdex::slurp(fn, ec);
+
+	REQUIRE(ec == std::errc::no_such_file_or_directory);
+	REQUIRE(s.empty());
+}
+
+#if !defined(_WIN32)
+// a local file read at most 100 bytes at a time
+struct short_reader
+{
+	int read(char* p, int sz)
+	{
+		return int(::read(fd_, p, size_t(std::min(sz, 100))));
+	}
+
+	int fd() const
+	{
+		return fd_;
+	}
+
+	int close()
+	{
+		return ::close(fd_);
+	}
+
+	int fd_;
+};
+
+TEST_CASE("reading everything in short reads")
+{
+	auto fn = random_filename("fileio_t_");
+	std::string s1(10000, '\0');
+	for (size_t i = 0; i < s1.size(); ++i)
+		s1[i] = char('a' + i % 26);
+
+	{
+		auto f = open_file(fn, "w");
+		f.print(s1);
+	}
+
+	auto fd = ::open(fn.data(), O_RDONLY);
+	REQUIRE(fd != -1);
+
+	file fh(short_reader{fd}, opening::for_read);
+
+	REQUIRE(fh.stat().size == 10000);
+	REQUIRE(read_all(fh) == stdex::string_view(s1));
+
+	::remove(fn.data());
+}
+#endif
+
 TEST_CASE("invalid mode strings")
 {
 	auto fn = random_filename("fileio_t_");
@@ -0,0 +1,163 @@
+#include <fileio.h>
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "test_data.h"
+
+#include <thread>
+#include <vector>
+
+namespace pmr = xstd::polyalloc;
+
+using stdex::file;
+using stdex::opening;
+
+struct test_writer
+{
+	int write(char const* p, int sz)
+	{
+		s.append(p, sz);
+		return sz;
+	}
+
+	std::string& s;
+};
+
+TEST_CASE("synchronized pool across threads")
+{
+	pmr::synchronized_pool_resource r;
+	std::vector<void*> blocks(4000);
+	std::vector<std::thread> threads;
+
+	auto size_of = [](int i)
+	{
+		return size_t(8) << (i % 8);
+	};
+
+	for (int t = 0; t < 4; ++t)
+		threads.emplace_back([&, t]
+		    {
+			for (int i = 0; i < 1000; ++i)
+			{
+				auto p = r.allocate(size_of(i));
+				memset(p, t, size_of(i));
+				blocks[t * 1000 + i] = p;
+			}
+		    });
+	for (auto& th : threads)
+		th.join();
+	threads.clear();
+
+	// freed by another thread than the one allocated them
+	for (int t = 0; t < 4; ++t)
+		threads.emplace_back([&, t]
+		    {
+			for (int i = 0; i < 1000; ++i)
+				r.deallocate(blocks[(3 - t) * 1000 + i],
+				    size_of(i));
+		    });
+	for (auto& th : threads)
+		th.join();
+
+	// files opened from many threads through the default resource
+	auto prev = pmr::set_default_resource(&r);
+	threads.clear();
+
+	std::string out[4];
+
+	for (int t = 0; t < 4; ++t)
+		threads.emplace_back([&, t]
+		    {
+			for (int i = 0; i < 100; ++i)
+			{
+				file fh(test_writer{out[t]},
+				    opening::for_write |
+				    opening::fully_buffered, 4096);
+				fh.print("Natsuiro Egao de 1,2,Jump!");
+			}
+		    });
+	for (auto& th : threads)
+		th.join();
+
+	for (auto& s : out)
+		REQUIRE(s.size() == 2600);
+
+	REQUIRE(pmr::set_default_resource(prev) == &r);
+}
+
+TEST_CASE("statistics of file allocations")
+{
+	pmr::stats_resource r;
+	std::string s;
+
+	{
+		file f1(std::allocator_arg, &r, test_writer{s},
+		    opening::for_write | opening::fully_buffered, 4000);
+		file f2(std::allocator_arg, &r, test_writer{s},
+		    opening::for_write | opening::fully_buffered, 100);
+
+		f1.print("Yume no Tobira");
+		f2.print("Wonder zone");
+
+		auto st = r.snapshot();
+		auto& buffers = st.for_alignment(file::buffer_alignment);
+
+		REQUIRE(buffers.alignment == file::buffer_alignment);
+		REQUIRE(buffers.allocations == 2);
+		REQUIRE(buffers.bytes_in_use == 4100);
+		REQUIRE(buffers.histogram[7] == 1);
+		REQUIRE(buffers.histogram[12] == 1);
+
+		// the rest are the io_core objects
+		REQUIRE(st.total.allocations == 4);
+		REQUIRE(st.total.bytes_in_use > 4100);
+	}
+
+	auto st = r.snapshot();
+	auto& buffers = st.for_alignment(file::buffer_alignment);
+
+	REQUIRE(buffers.deallocations == 2);
+	REQUIRE(buffers.bytes_in_use == 0);
+	REQUIRE(buffers.peak_bytes_in_use == 4100);
+	REQUIRE(st.total.bytes_in_use == 0);
+	REQUIRE(st.for_alignment(4096).allocations == 0);
+
+	r.reset();
+	REQUIRE(r.snapshot().total.allocations == 0);
+	REQUIRE(r.snapshot().total.peak_bytes_in_use == 0);
+}
+
+TEST_CASE("huge pages for large buffers")
+{
+	pmr::stats_resource up;
+	pmr::huge_page_resource r(1024 * 1024, &up);
+
+	REQUIRE(r.threshold() == 1024 * 1024);
+	REQUIRE(r.huge_page_size() >= 4096);
+
+	auto p = static_cast<char*>(r.allocate(4 * 1024 * 1024, 2));
+	memset(p, '#', 4 * 1024 * 1024);
+
+	REQUIRE(size_t(p) % 4096 == 0);
+	r.deallocate(p, 4 * 1024 * 1024, 2);
+
+	// small requests go upstream
+	r.deallocate(r.allocate(4096, 2), 4096, 2);
+
+	auto st = up.snapshot();
+#if !defined(_WIN32)
+	REQUIRE(st.total.allocations == 1);
+#endif
+	REQUIRE(st.total.bytes_in_use == 0);
+
+	std::string s;
+	{
+		file fh(std::allocator_arg, &r, test_writer{s},
+		    opening::for_write | opening::fully_buffered,
+		    8 * 1024 * 1024);
+
+		fh.print("Snow halation");
+	}
+
+	REQUIRE(s == "Snow halation");
+}
@@ -0,0 +1,167 @@
+#include <fileio.h>
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+using stdex::file;
+using stdex::opening;
+using stdex::fixed;
+
+struct test_writer
+{
+	int write(char const* p, int sz)
+	{
+		s.append(p, sz);
+		++calls;
+		return sz;
+	}
+
+	std::string& s;
+	int& calls;
+};
+
+namespace
+{
+struct two_fields
+{
+	static constexpr char const* str()
+	{
+		return "{{{}}} = {}";
+	}
+};
+
+using fmt = stdex::format_string<two_fields>;
+static_assert(fmt::well_formed, "");
+static_assert(fmt::fields == 2, "");
+static_assert(fmt::text_size == 5, "");
+static_assert(fmt::text_length(0) == 1 and fmt::text_length(1) == 4 and
+    fmt::text_length(2) == 0, "");
+}
+
+TEST_CASE("printing with format strings")
+{
+	std::string s;
+	int calls = 0;
+
+	SECTION("fields and braces")
+	{
+		file fh(test_writer{s, calls}, opening::for_write |
+		    opening::fully_buffered, 64);
+		std::string name = "open";
+
+		fh.print(STDEX_FMT("{} took {} ms, {}%\n"), name, 12u, 0.5);
+		fh.print(STDEX_FMT("{{{}}} {}{}"), "set", 'x', -7);
+		fh.print(STDEX_FMT("}}done{{\n"));
+		fh.flush();
+
+		REQUIRE(s == "open took 12 ms, 0.5%\n{set} x-7}done{\n");
+		REQUIRE(calls == 1);
+	}
+
+	SECTION("one write per record when unbuffered")
+	{
+		file fh(test_writer{s, calls}, opening::for_write);
+
+		fh.print(STDEX_FMT("[{}] {}: {}\n"), 3, "warning", 2.5f);
+
+		REQUIRE(s == "[3] warning: 2.5\n");
+		REQUIRE(calls == 1);
+	}
+
+	SECTION("flushed once when line buffered")
+	{
+		file fh(test_writer{s, calls}, opening::for_write |
+		    opening::line_buffered, 64);
+
+		fh.print(STDEX_FMT("{}\n{}\n"), 1, 2);
+		REQUIRE(s == "1\n2\n");
+		REQUIRE(calls == 1);
+
+		fh.print(STDEX_FMT("{} "), 3);
+		REQUIRE(calls == 1);
+	}
+
+	SECTION("fields without a bound or too long")
+	{
+		file fh(test_writer{s, calls}, opening::for_write |
+		    opening::fully_buffered, 16);
+		std::string long_one(40, 'a');
+
+		fh.print(STDEX_FMT("<{}> {}|"), long_one, 1);
+		fh.print(STDEX_FMT("{}, {}"), fixed(1.0, 2), L'w');
+		fh.print(STDEX_FMT(" {}{}"), u"u16", std::u32string(U"u32"));
+		fh.flush();
+
+		REQUIRE(s == "<" + long_one + "> 1|1.00, w u16u32");
+	}
+
+	SECTION("the error goes to the trailing error_code")
+	{
+		file fh(test_writer{s, calls}, opening::for_read);
+		std::error_code ec;
+
+		fh.print(STDEX_FMT("{}\n"), 42, ec);
+		REQUIRE(ec == std::errc::bad_file_descriptor);
+
+		REQUIRE_THROWS(fh.print(STDEX_FMT("{}\n"), 42));
+		REQUIRE_THROWS(fh.print(STDEX_FMT("{}, {}"), 4.2, fixed(1.0)));
+	}
+}
+
+TEST_CASE("printing several values")
+{
+	std::string s;
+	int calls = 0;
+
+	SECTION("one write when unbuffered")
+	{
+		file fh(test_writer{s, calls}, opening::for_write);
+		std::string name = "read";
+
+		fh.print(name, ' ', 1, "st ", 0.25, ' ', -3ll, 'x', 1.5f, '\n');
+
+		REQUIRE(s == "read 1st 0.25 -3x1.5\n");
+		REQUIRE(calls == 1);
+	}
+
+	SECTION("flushed once when line buffered")
+	{
+		file fh(test_writer{s, calls}, opening::for_write |
+		    opening::line_buffered, 64);
+
+		fh.print("a\n", 'b', '\n');
+		REQUIRE(s == "a\nb\n");
+		REQUIRE(calls == 1);
+
+		fh.print(1, 2);
+		REQUIRE(calls == 1);
+		fh.flush();
+		REQUIRE(s == "a\nb\n12");
+	}
+
+	SECTION("mixed with fields without a bound")
+	{
+		file fh(test_writer{s, calls}, opening::for_write |
+		    opening::fully_buffered, 64);
+
+		fh.print(L"w", ' ', fixed(2.0, 1), ' ', 3);
+		fh.flush();
+
+		REQUIRE(s == "w 2.0 3");
+	}
+
+	SECTION("the error goes to the trailing error_code")
+	{
+		file fh(test_writer{s, calls}, opening::for_read);
+		std::error_code ec;
+
+		fh.print("x = ", 42, ec);
+		REQUIRE(ec == std::errc::bad_file_descriptor);
+
+		ec.clear();
+		fh.print("x", ec);
+		REQUIRE(ec == std::errc::bad_file_descriptor);
+
+		REQUIRE_THROWS(fh.print("x = ", 42));
+	}
+}
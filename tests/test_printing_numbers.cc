@@ -0,0 +1,286 @@
+#include <fileio.h>
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+
+using stdex::file;
+using stdex::opening;
+using stdex::fixed;
+using stdex::scientific;
+
+struct test_writer
+{
+	int write(char const* p, int sz)
+	{
+		s.append(p, sz);
+		return sz;
+	}
+
+	std::string& s;
+};
+
+TEST_CASE("printing integers")
+{
+	std::string s;
+
+	SECTION("all the types")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 64);
+
+		fh.print(0);
+		fh.print(' ');
+		fh.print(short(-32768));
+		fh.print(' ');
+		fh.print(7u);
+		fh.print(' ');
+		fh.print((signed char)-5);
+		fh.print(' ');
+		fh.print((unsigned char)200);
+		fh.print(' ');
+		fh.print(std::numeric_limits<long long>::min());
+		fh.print(' ');
+		fh.print(std::numeric_limits<unsigned long long>::max());
+		fh.flush();
+
+		REQUIRE(s == "0 -32768 7 -5 200 -9223372036854775808 "
+		    "18446744073709551615");
+	}
+
+	SECTION("every number of digits")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 64);
+		std::string expected;
+
+		unsigned long long x = 1;
+		for (int i = 0; i < 20; ++i, x *= 10)
+		{
+			for (auto y : { x - 1, x, x + 1, x * 5 + 3 })
+			{
+				fh.print(y);
+				fh.print(-(long long)(y / 2));
+				fh.print('\n');
+				expected += std::to_string(y);
+				expected += std::to_string(-(long long)(y / 2));
+				expected += '\n';
+			}
+		}
+		fh.flush();
+
+		REQUIRE(s == expected);
+	}
+
+	SECTION("buffer too small or none")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 4);
+
+		fh.print(-1234567);
+		fh.print(89);
+		fh.flush();
+		REQUIRE(s == "-123456789");
+
+		file fh2(test_writer{s}, opening::for_write);
+		fh2.print(10);
+		REQUIRE(s == "-12345678910");
+	}
+
+	SECTION("not opened for write")
+	{
+		file fh(test_writer{s}, opening::for_read);
+		std::error_code ec;
+		fh.print(42, ec);
+
+		REQUIRE(ec == std::errc::bad_file_descriptor);
+	}
+}
+
+TEST_CASE("printing floating-point numbers")
+{
+	std::string s;
+
+	SECTION("special values")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 64);
+		using lim = std::numeric_limits<double>;
+
+		for (auto x : { 0.0, -0.0, lim::infinity(), -lim::infinity(),
+		    lim::quiet_NaN(), lim::denorm_min(), lim::min(),
+		    lim::max() })
+		{
+			fh.print(x);
+			fh.print(' ');
+		}
+		fh.flush();
+
+		REQUIRE(s == "0 -0 inf -inf nan 5e-324 "
+		    "2.2250738585072014e-308 1.7976931348623157e+308 ");
+	}
+
+	SECTION("fixed unless scientific is shorter")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 64);
+
+		for (auto x : { 0.1, 1.5, -123456.0, 1e4, 1e5, 1e22, 0.001,
+		    1e-5, 12345e-10, 2.5e15, 1234567e3 })
+		{
+			fh.print(x);
+			fh.print(' ');
+		}
+		fh.flush();
+
+		REQUIRE(s == "0.1 1.5 -123456 10000 1e+05 1e+22 0.001 1e-05 "
+		    "1.2345e-06 2.5e+15 1234567000 ");
+	}
+
+	SECTION("float")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 64);
+
+		for (auto x : { 0.1f, 16777216.f, -1.1754944e-38f,
+		    std::numeric_limits<float>::max() })
+		{
+			fh.print(x);
+			fh.print(' ');
+		}
+		fh.flush();
+
+		REQUIRE(s == "0.1 16777216 -1.1754944e-38 3.4028235e+38 ");
+	}
+
+	SECTION("round trip with the fewest digits")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 32);
+		std::mt19937_64 gen;
+
+		for (int i = 0; i < 10000; ++i)
+		{
+			double x;
+			auto bits = gen();
+			memcpy(&x, &bits, sizeof(x));
+			if (x != x or x - x != 0)
+				continue;
+
+			s.clear();
+			fh.print(x);
+			fh.flush();
+
+			REQUIRE(strtod(s.data(), nullptr) == x);
+
+			auto e = s.find('e');
+			auto digits = s.substr(0, e);
+			digits.erase(0, digits.find_first_not_of("-0."));
+			if (e == std::string::npos)
+				digits.erase(digits.find_last_not_of("0.") + 1);
+			digits.erase(std::remove(digits.begin(), digits.end(),
+			    '.'), digits.end());
+
+			char buf[32];
+			auto n = int(digits.size()) - 1;
+			if (n > 0)
+			{
+				snprintf(buf, sizeof(buf), "%.*e", n - 1, x);
+				REQUIRE(strtod(buf, nullptr) != x);
+			}
+		}
+	}
+
+	SECTION("fixed and scientific precision")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 16);
+
+		fh.print(fixed(3.14159, 2));
+		fh.print(' ');
+		fh.print(fixed(2.5));
+		fh.print(' ');
+		fh.print(scientific(-1234.5, 3));
+		fh.print(' ');
+		fh.print(fixed(1e100, 0));
+		fh.flush();
+
+		REQUIRE(s == "3.14 2.500000 -1.234e+03 "
+		    "1000000000000000015902891109759918046836080856394528138978"
+		    "1327557747838772170381060813469985856815104");
+	}
+
+	SECTION("fixed and scientific as printf writes them")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 32);
+		std::mt19937_64 gen;
+		char buf[2048];
+
+		auto check = [&](double x, int prec)
+		{
+			s.clear();
+			fh.print(fixed(x, prec));
+			fh.flush();
+			snprintf(buf, sizeof(buf), "%.*f", prec, x);
+			REQUIRE(s == buf);
+
+			s.clear();
+			fh.print(scientific(x, prec));
+			fh.flush();
+			snprintf(buf, sizeof(buf), "%.*e", prec, x);
+			REQUIRE(s == buf);
+		};
+
+		for (auto x : { 0.0, -0.0, 0.125, 1.005, 9.995, 9.9999999,
+		    -0.0004, 999.9996, 1e15, 1e16, 5e-324, 1e308 })
+			for (int prec = 0; prec < 25; ++prec)
+				check(x, prec);
+
+		for (int i = 0; i < 20000; ++i)
+		{
+			double x;
+			if (i % 2)
+			{
+				auto bits = gen();
+				memcpy(&x, &bits, sizeof(x));
+				if (x != x or x - x != 0)
+					continue;
+			}
+			else
+				x = double(int64_t(gen() % 2000001) - 1000000) /
+				    double(1 + gen() % 10000);
+
+			check(x, int(gen() % 20));
+		}
+	}
+
+	SECTION("buffer too small or none")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 4);
+
+		fh.print(-0.125);
+		fh.print(2.5f);
+		fh.flush();
+		REQUIRE(s == "-0.1252.5");
+
+		file fh2(test_writer{s}, opening::for_write);
+		fh2.print(1e100);
+		REQUIRE(s == "-0.1252.51e+100");
+	}
+
+	SECTION("not opened for write")
+	{
+		file fh(test_writer{s}, opening::for_read);
+		std::error_code ec;
+		fh.print(4.2, ec);
+
+		REQUIRE(ec == std::errc::bad_file_descriptor);
+	}
+}
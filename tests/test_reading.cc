@@ -25,6 +25,20 @@ struct test_reader
 	size_t pos = 0;
 };
 
+// a reader which reads as much as it can
+struct string_reader
+{
+	int read(char* p, int sz)
+	{
+		auto n = s.copy(p, sz, pos);
+		pos += n;
+		return int(n);
+	}
+
+	std::string& s;
+	size_t pos = 0;
+};
+
 // a reader which gives error on the second read
 struct half_faulty_reader
 {
@@ -201,3 +215,272 @@ TEST_CASE("error reporting")
 		REQUIRE(r.count() == 0);
 	}
 }
+
+TEST_CASE("giving back idle buffers")
+{
+	std::string s1 = "Mogyutto 'love' de sekkinchuu!";
+	char s[40];
+	file::io_result r;
+
+	SECTION("on request")
+	{
+		file fh(string_reader{s1}, opening::for_read, 64);
+
+		r = fh.read(s, 5);
+
+		REQUIRE(r);
+		REQUIRE_FALSE(fh.shrink());
+
+		r = fh.read(s + 5, 40);
+
+		REQUIRE_FALSE(r);
+		REQUIRE(fh.shrink());
+		REQUIRE(stdex::string_view(s, s1.size()) == s1);
+
+		REQUIRE_FALSE(fh.read(s, 1));
+	}
+
+	SECTION("not on every refill")
+	{
+		xstd::polyalloc::stats_resource st;
+		file fh(std::allocator_arg, &st, test_reader{s1},
+		    opening::for_read | opening::shrink_when_idle, 8);
+
+		char c;
+		std::string x;
+		while ((r = fh.read(c)))
+			x.push_back(c);
+
+		REQUIRE(x == s1);
+		REQUIRE(st.snapshot().for_alignment(file::buffer_alignment)
+		    .allocations == 1);
+		REQUIRE(fh.shrink());
+	}
+}
+
+TEST_CASE("adapting the buffer size")
+{
+	std::string s1(100000, 'x');
+	std::string x;
+	char s[100];
+	xstd::polyalloc::stats_resource st;
+
+	auto buffers_in_use = [&]
+	{
+		return st.snapshot().for_alignment(file::buffer_alignment)
+		    .bytes_in_use;
+	};
+
+	file fh(std::allocator_arg, &st, string_reader{s1},
+	    opening::for_read, 256);
+	fh.adapt_buffer(256, 16384);
+
+	file::io_result r;
+	while ((r = fh.read(s, sizeof(s))))
+		x.append(s, r.count());
+	x.append(s, r.count());
+
+	REQUIRE(x == s1);
+	REQUIRE(buffers_in_use() > 256);
+	REQUIRE(buffers_in_use() <= 16384);
+}
+
+TEST_CASE("changing the buffering")
+{
+	std::string s1 = "Yume no tobira, zutto sagashitsuzuketa";
+	std::string x;
+	char s[40];
+	file::io_result r;
+
+	file fh(string_reader{s1}, opening::for_read, 64);
+
+	r = fh.read(s, 5);
+	REQUIRE(r);
+	x.append(s, r.count());
+
+	// keeps what was read ahead
+	fh.set_buffering(opening::fully_buffered, 4);
+	r = fh.read(s, 10);
+	REQUIRE(r);
+	x.append(s, r.count());
+
+	fh.set_buffering(opening::fully_buffered, 4);
+	while ((r = fh.read(s, 3)))
+		x.append(s, r.count());
+	x.append(s, r.count());
+
+	REQUIRE(x == s1);
+}
+
+TEST_CASE("reading everything")
+{
+	std::string s1(20000, '\0');
+	for (size_t i = 0; i < s1.size(); ++i)
+		s1[i] = char('a' + i % 26);
+
+	xstd::polyalloc::stats_resource st;
+
+	SECTION("from the start")
+	{
+		file fh(test_reader{s1}, opening::for_read);
+		auto s = read_all(fh, &st);
+
+		REQUIRE(s == stdex::string_view(s1));
+		REQUIRE(s.get_allocator().resource() == &st);
+		REQUIRE(st.snapshot().for_alignment(file::buffer_alignment)
+		    .allocations == 0);
+		REQUIRE_FALSE(fh.read(s.front()));
+	}
+
+	SECTION("after some reads")
+	{
+		file fh(string_reader{s1}, opening::for_read, 64);
+		char s[10];
+
+		REQUIRE(fh.read(s, sizeof(s)));
+		REQUIRE(read_all(fh) == stdex::string_view(s1).substr(10));
+		REQUIRE(read_all(fh).empty());
+	}
+}
+
+TEST_CASE("scanning the buffer in place")
+{
+	std::string s1 = "Mirai no bokura wa shitteru yo";
+	std::string x;
+
+	SECTION("consuming everything")
+	{
+		file fh(test_reader{s1}, opening::for_read, 8);
+
+		stdex::string_view v;
+		while (!(v = fh.fill()).empty())
+		{
+			REQUIRE(v.size() <= 8);
+			x.append(v.data(), v.size());
+			fh.consume(v.size());
+		}
+
+		REQUIRE(x == s1);
+	}
+
+	SECTION("no refill until consumed")
+	{
+		file fh(string_reader{s1}, opening::for_read, 16);
+
+		auto v = fh.fill();
+		REQUIRE(v == "Mirai no bokura ");
+
+		fh.consume(6);
+		REQUIRE(fh.fill() == "no bokura ");
+
+		char c;
+		REQUIRE(fh.read(c));
+		REQUIRE(c == 'n');
+
+		fh.consume(9);
+		REQUIRE(fh.fill() == "wa shitteru yo");
+	}
+
+	SECTION("errors")
+	{
+		file fh(half_faulty_reader(), opening::for_read, 8);
+
+		REQUIRE(fh.fill() == "@@@@");
+		fh.consume(4);
+
+		std::error_code ec;
+		errno = EIO;
+		REQUIRE(fh.fill(ec).empty());
+		REQUIRE(ec == std::errc::io_error);
+	}
+}
+
+TEST_CASE("reading lines")
+{
+	std::string s1 = "Kaguya no shiro de\nodoritai\n\nJust woo!";
+
+	SECTION("into a string")
+	{
+		file fh(test_reader{s1}, opening::for_read, 8);
+		xstd::polyalloc::string x;
+		file::io_result r;
+
+		r = fh.read_until('\n', x);
+		REQUIRE(r);
+		REQUIRE(r.count() == 19);
+		REQUIRE(x == "Kaguya no shiro de\n");
+
+		r = fh.read_until('\n', x);
+		REQUIRE(r);
+		REQUIRE(x == "Kaguya no shiro de\nodoritai\n");
+
+		x.clear();
+		r = fh.read_until('\n', x);
+		REQUIRE(r);
+		REQUIRE(x == "\n");
+
+		x.clear();
+		r = fh.read_until('\n', x);
+		REQUIRE_FALSE(r);
+		REQUIRE(r.count() == 9);
+		REQUIRE(x == "Just woo!");
+
+		r = fh.read_until('\n', x);
+		REQUIRE_FALSE(r);
+		REQUIRE(r.count() == 0);
+	}
+
+	SECTION("as views")
+	{
+		file fh(test_reader{s1}, opening::for_read, 16);
+		std::vector<std::string> v;
+		stdex::string_view sv;
+
+		while (!(sv = fh.read_until('\n')).empty())
+			v.push_back(sv.to_string());
+
+		// the first line does not fit
+		REQUIRE(v.size() == 5);
+		REQUIRE(v[0] == "Kaguya no shiro ");
+		REQUIRE(v[1] == "de\n");
+		REQUIRE(v[2] == "odoritai\n");
+		REQUIRE(v[3] == "\n");
+		REQUIRE(v[4] == "Just woo!");
+	}
+}
+
+TEST_CASE("iterating over lines")
+{
+	std::string s1 = "Yes!\nSunshine!!\n\nMIRAI TICKET wo te ni\nAqours";
+	xstd::polyalloc::stats_resource st;
+
+	auto split = [&](file& fh)
+	{
+		std::vector<std::string> v;
+		for (auto ln : lines(fh, '\n', &st))
+			v.push_back(ln.to_string());
+
+		REQUIRE(v.size() == 5);
+		REQUIRE(v[0] == "Yes!");
+		REQUIRE(v[1] == "Sunshine!!");
+		REQUIRE(v[2] == "");
+		REQUIRE(v[3] == "MIRAI TICKET wo te ni");
+		REQUIRE(v[4] == "Aqours");
+	};
+
+	SECTION("fitting the buffer")
+	{
+		file fh(test_reader{s1}, opening::for_read, 32);
+		split(fh);
+
+		REQUIRE(st.snapshot().total.allocations == 0);
+	}
+
+	SECTION("longer than the buffer")
+	{
+		file fh(test_reader{s1}, opening::for_read, 4);
+		split(fh);
+
+		REQUIRE(st.snapshot().total.allocations == 1);
+	}
+}
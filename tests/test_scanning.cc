@@ -0,0 +1,203 @@
+#include <fileio.h>
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "test_data.h"
+
+#include <limits>
+#include <string.h>
+
+using stdex::file;
+using stdex::opening;
+
+// a reader which often reads less bytes
+struct test_reader
+{
+	int read(char* p, int sz)
+	{
+		auto z = randint(1, sz);
+		auto n = s.copy(p, z, pos);
+		pos += n;
+		return int(n);
+	}
+
+	std::string& s;
+	size_t pos = 0;
+};
+
+TEST_CASE("scanning integers")
+{
+	std::string s = "  42\n-7\t+0 0009223372036854775807 "
+	    "-9223372036854775808";
+
+	auto check = [&](size_t bufsize)
+	{
+		file fh(test_reader{s}, opening::for_read |
+		    opening::fully_buffered, bufsize);
+		int64_t x;
+
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == 42);
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == -7);
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == 0);
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == std::numeric_limits<int64_t>::max());
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == std::numeric_limits<int64_t>::min());
+		REQUIRE_FALSE(fh.scan(x));
+		REQUIRE(x == std::numeric_limits<int64_t>::min());
+	};
+
+	SECTION("within the buffer")
+	{
+		check(64);
+	}
+
+	SECTION("across refills")
+	{
+		check(8);
+	}
+
+	SECTION("longer than the buffer")
+	{
+		check(4);
+	}
+
+	SECTION("stops before what is not a number")
+	{
+		s = "12,-3;x 5";
+		file fh(test_reader{s}, opening::for_read |
+		    opening::fully_buffered, 64);
+		int64_t x = 0;
+		char c;
+
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == 12);
+		REQUIRE(fh.read(c));
+		REQUIRE(c == ',');
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == -3);
+		REQUIRE(fh.read(c));
+		REQUIRE(c == ';');
+		REQUIRE_FALSE(fh.scan(x));
+		REQUIRE(x == -3);
+		REQUIRE(fh.read(c));
+		REQUIRE(c == 'x');
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == 5);
+	}
+
+	SECTION("out of range")
+	{
+		s = "9223372036854775808 18446744073709551616 1";
+		file fh(test_reader{s}, opening::for_read |
+		    opening::fully_buffered, 64);
+		int64_t x = 0;
+		std::error_code ec;
+
+		REQUIRE_FALSE(fh.scan(x, ec));
+		REQUIRE(ec == std::errc::result_out_of_range);
+		REQUIRE_THROWS(fh.scan(x));
+		REQUIRE(fh.scan(x));
+		REQUIRE(x == 1);
+	}
+}
+
+TEST_CASE("scanning floating-point numbers")
+{
+	auto scan_all = [](std::string s, size_t bufsize)
+	{
+		file fh(test_reader{s}, opening::for_read |
+		    opening::fully_buffered, bufsize);
+		std::vector<double> v;
+		double x;
+		while (fh.scan(x))
+			v.push_back(x);
+		return v;
+	};
+
+	SECTION("fast and slow paths")
+	{
+		std::string s = "1.5 -0.25e2 .5 3. 1e22 1e23 0.1 -0 "
+		    "123456789012345678901234567890 2.2250738585072014e-308 "
+		    "inf -nan 0x1p4 4.9406564584124654e-324 00012.75e-1";
+
+		for (size_t bufsize : { 128, 16, 4 })
+		{
+			auto v = scan_all(s, bufsize);
+
+			REQUIRE(v.size() == 15);
+			REQUIRE(v[0] == 1.5);
+			REQUIRE(v[1] == -25);
+			REQUIRE(v[2] == 0.5);
+			REQUIRE(v[3] == 3);
+			REQUIRE(v[4] == 1e22);
+			REQUIRE(v[5] == 1e23);
+			REQUIRE(v[6] == 0.1);
+			REQUIRE(v[7] == 0);
+			REQUIRE(std::signbit(v[7]));
+			REQUIRE(v[8] == 123456789012345678901234567890.);
+			REQUIRE(v[9] == std::numeric_limits<double>::min());
+			REQUIRE(v[10] == std::numeric_limits<double>::infinity());
+			REQUIRE(v[11] != v[11]);
+			REQUIRE(v[12] == 16);
+			REQUIRE(v[13] == std::numeric_limits<double>::denorm_min());
+			REQUIRE(v[14] == 1.275);
+		}
+	}
+
+	SECTION("as strtod reads them")
+	{
+		std::string s;
+		std::vector<double> expected;
+
+		for (int i = 0; i < 2000; ++i)
+		{
+			char buf[64];
+			auto digits = randint(1, 25);
+			auto e = randint(-330, 300);
+			auto n = snprintf(buf, sizeof(buf), "%.*e ", digits,
+			    randint(1, 9999) / 1000. * (i % 2 ? -1 : 1));
+			snprintf(strchr(buf, 'e'), sizeof(buf) - size_t(n),
+			    "e%d ", e);
+			s += buf;
+			expected.push_back(strtod(buf, nullptr));
+		}
+
+		REQUIRE(scan_all(s, 4096) == expected);
+		REQUIRE(scan_all(s, 16) == expected);
+	}
+
+	SECTION("out of range and not a number")
+	{
+		std::string s = "1e400 . -";
+		file fh(test_reader{s}, opening::for_read |
+		    opening::fully_buffered, 64);
+		double x = 2;
+		std::error_code ec;
+
+		REQUIRE_FALSE(fh.scan(x, ec));
+		REQUIRE(ec == std::errc::result_out_of_range);
+		REQUIRE(x == 2);
+
+		ec.clear();
+		REQUIRE_FALSE(fh.scan(x, ec));
+		REQUIRE_FALSE(ec);
+		REQUIRE(x == 2);
+	}
+}
+
+TEST_CASE("skipping white space")
+{
+	std::string s = " \t\r\n\v\fx  ";
+	file fh(test_reader{s}, opening::for_read |
+	    opening::fully_buffered, 4);
+	char c;
+
+	REQUIRE(fh.skip_space());
+	REQUIRE(fh.read(c));
+	REQUIRE(c == 'x');
+	REQUIRE_FALSE(fh.skip_space());
+}
@@ -0,0 +1,95 @@
+#include "../src/string_algo.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <string>
+
+template <typename CharT>
+void check_rfind(std::basic_string<CharT> const& s, CharT c)
+{
+	for (size_t n = 0; n <= s.size(); ++n)
+	{
+		auto p = s.data();
+		auto expected = stdex::rfind<CharT>(p, n, c);
+
+		REQUIRE(stdex::rfind(p, n, c) == expected);
+		REQUIRE(stdex::rfind(p + 1, n - (n != 0), c) ==
+		    stdex::rfind<CharT>(p + 1, n - (n != 0), c));
+	}
+}
+
+TEST_CASE("rfind")
+{
+	std::string s(100, 'x');
+	std::wstring ws(100, L'x');
+
+	SECTION("not found")
+	{
+		check_rfind(s, '\n');
+		check_rfind(ws, L'\n');
+	}
+
+	SECTION("found at every position")
+	{
+		for (size_t i = 0; i < s.size(); i += 7)
+		{
+			s[i] = '\n';
+			ws[i] = L'\n';
+			check_rfind(s, '\n');
+			check_rfind(ws, L'\n');
+		}
+	}
+
+	SECTION("characters sharing bytes with the needle")
+	{
+		ws[50] = wchar_t(0x0a0a);
+		ws[60] = L'\n';
+		check_rfind(ws, L'\n');
+	}
+}
+
+TEST_CASE("find")
+{
+	std::string s = "Tokimeki Runners\n";
+	std::wstring ws = L"Tokimeki Runners\n";
+
+	REQUIRE(stdex::find(s.data(), s.size(), 'e') == s.data() + 5);
+	REQUIRE(stdex::find(s.data(), 5, 'e') == nullptr);
+	REQUIRE(stdex::find(ws.data(), ws.size(), L'\n') ==
+	    ws.data() + 16);
+	REQUIRE(stdex::find(ws.data(), ws.size(), L'z') == nullptr);
+}
+
+template <typename CharT>
+void check_narrow_ascii(std::initializer_list<CharT> non_ascii)
+{
+	std::basic_string<CharT> ws;
+	for (int i = 0; i < 100; ++i)
+		ws += CharT(i % 0x80);
+	char buf[100];
+
+	REQUIRE(stdex::narrow_ascii(buf, ws.data(), ws.size()) == 100);
+	REQUIRE(std::string(buf, 100) == std::string(ws.begin(), ws.end()));
+
+	for (auto c : non_ascii)
+	{
+		for (size_t i = 0; i < ws.size(); i += 3)
+		{
+			auto ws2 = ws;
+			ws2[i] = c;
+
+			REQUIRE(stdex::narrow_ascii(buf, ws2.data(),
+			    ws2.size()) == i);
+			REQUIRE(stdex::narrow_ascii(buf, ws2.data(), i / 2) ==
+			    i / 2);
+		}
+	}
+}
+
+TEST_CASE("narrow_ascii")
+{
+	check_narrow_ascii<wchar_t>({ 0x80, 0x100, wchar_t(-1) });
+	check_narrow_ascii<char16_t>({ 0x80, 0x100, 0xd800, 0xffff });
+	check_narrow_ascii<char32_t>({ 0x80, 0x100, 0x10ffff });
+}
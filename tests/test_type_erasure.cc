@@ -121,6 +121,59 @@ TEST_CASE("error handling")
 	REQUIRE(ec == std::errc::not_supported);
 }
 
+TEST_CASE("transfer sizes")
+{
+	// never touches the bytes, so any length can be written
+	struct wide_writer
+	{
+		ptrdiff_t write(char const*, size_t x)
+		{
+			largest = std::max(largest, x);
+			return x;
+		}
+
+		size_t& largest;
+	};
+
+	struct int_writer
+	{
+		int write(char const*, int x)
+		{
+			largest = std::max(largest, size_t(x));
+			return x;
+		}
+
+		size_t& largest;
+	};
+
+	if (sizeof(size_t) == sizeof(int))
+		return;
+
+	auto huge = size_t(INT_MAX) + 10;
+	char x = '\0';
+	size_t largest = 0;
+
+	SECTION("a size_t backend takes it in one call")
+	{
+		file fh{wide_writer{largest}, opening::for_write};
+		auto r = fh.write(&x, huge);
+
+		REQUIRE(r);
+		REQUIRE(r.count() == huge);
+		REQUIRE(largest == huge);
+	}
+
+	SECTION("an int backend takes it in pieces")
+	{
+		file fh{int_writer{largest}, opening::for_write};
+		auto r = fh.write(&x, huge);
+
+		REQUIRE(r);
+		REQUIRE(r.count() == huge);
+		REQUIRE(largest == size_t(INT_MAX));
+	}
+}
+
 using stdex::signature;
 
 void do_f1(signature<void(char const*)> f)
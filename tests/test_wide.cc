@@ -185,3 +185,179 @@ TEST_CASE("printing strings")
 		REQUIRE(s == sv);
 	}
 }
+
+TEST_CASE("printing mostly ASCII strings")
+{
+	auto old = setlocale(LC_CTYPE, nullptr);
+	std::string saved = old ? old : "C";
+	if (setlocale(LC_CTYPE, "C.UTF-8") == nullptr)
+		return;
+
+	std::string s;
+	std::wstring ws;
+	for (int i = 0; i < 40; ++i)
+	{
+		ws += random_text(randint(0, 40), L"0123456789abcdef\n");
+		ws += L"é中\U0001f600"[randint(0, 2)];
+	}
+
+	std::string st(ws.size() * 4, '\0');
+	st.resize(wcstombs(&st[0], ws.data(), st.size()));
+
+	SECTION("fully buffered")
+	{
+		file fh(test_writer{s}, opening::for_write, 157);
+		fh.print(ws);
+		fh.flush();
+
+		REQUIRE(s == st);
+	}
+
+	SECTION("unbuffered")
+	{
+		file fh(test_writer{s}, opening::for_write);
+		fh.print(ws);
+
+		REQUIRE(s == st);
+	}
+
+	SECTION("every code point")
+	{
+		ws.clear();
+		for (wchar_t c = 1; c < 0x110000; ++c)
+		{
+			if (c < 0xd800 or c > 0xdfff)
+				ws += c;
+		}
+
+		st.resize(ws.size() * 4);
+		st.resize(wcstombs(&st[0], ws.data(), st.size()));
+
+		file fh(test_writer{s}, opening::for_write, 157);
+		fh.print(ws);
+		for (auto c : { L'\u00ff', L'\u0800', L'\U0010ffff' })
+		{
+			fh.print(c);
+			char buf[MB_LEN_MAX];
+			st.append(buf, wctomb(buf, c));
+		}
+		fh.flush();
+
+		REQUIRE(s == st);
+	}
+
+	SECTION("surrogates")
+	{
+		file fh(test_writer{s}, opening::for_write, 157);
+		std::error_code ec;
+
+		fh.print(L"ab\xd800", ec);
+		REQUIRE(ec == std::errc::illegal_byte_sequence);
+	}
+
+	setlocale(LC_CTYPE, saved.data());
+}
+
+TEST_CASE("printing UTF-16 and UTF-32")
+{
+	std::string s;
+	std::u16string u16 = u"héllo, 中文 \U0001f600!\n";
+	std::u32string u32 = U"héllo, 中文 \U0001f600!\n";
+	std::string st = u8"héllo, 中文 \U0001f600!\n";
+
+	SECTION("ASCII in any locale")
+	{
+		file fh(test_writer{s}, opening::for_write);
+		fh.print(std::u16string(u"plain\n"));
+		fh.print(std::u32string(U"text\n"));
+
+		REQUIRE(s == "plain\ntext\n");
+	}
+
+	auto old = setlocale(LC_CTYPE, nullptr);
+	std::string saved = old ? old : "C";
+	if (setlocale(LC_CTYPE, "C.UTF-8") == nullptr)
+		return;
+
+	SECTION("unbuffered")
+	{
+		file fh(test_writer{s}, opening::for_write);
+		fh.print(u16);
+		fh.print(u32);
+
+		REQUIRE(s == st + st);
+	}
+
+	SECTION("fully buffered, pairs across the end of the buffer")
+	{
+		file fh(test_writer{s}, opening::for_write, 157);
+		std::u16string l16;
+		std::u32string l32;
+		std::string expected;
+		for (int i = 0; i < 50; ++i)
+		{
+			auto n = size_t(i % 13);
+			l16 += std::u16string(n, u'x') + u16;
+			l32 += std::u32string(n, U'y') + u32;
+			expected += std::string(n, 'x') + st;
+		}
+		for (int i = 0; i < 50; ++i)
+			expected += std::string(size_t(i % 13), 'y') + st;
+
+		fh.print(l16);
+		fh.print(l32);
+		fh.flush();
+
+		REQUIRE(s == expected);
+	}
+
+	SECTION("line buffered")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::line_buffered, 64);
+		fh.print(u16 + u"tail");
+
+		REQUIRE(s == st);
+		fh.flush();
+		REQUIRE(s == st + "tail");
+	}
+
+	SECTION("asked for a buffer smaller than one character")
+	{
+		for (auto mode : { opening::unbuffered, opening::fully_buffered,
+		    opening::line_buffered })
+		{
+			for (size_t bufsize : { 1, 2, 3 })
+			{
+				s.clear();
+				file fh(test_writer{s}, opening::for_write | mode,
+				    bufsize);
+				fh.print(u16);
+				fh.print(u32);
+				fh.print(L"é中\n");
+				fh.flush();
+
+				REQUIRE(s == st + st + u8"é中\n");
+			}
+		}
+	}
+
+	SECTION("lone surrogates")
+	{
+		file fh(test_writer{s}, opening::for_write, 64);
+		std::error_code ec;
+
+		fh.print(std::u16string(u"ab") + char16_t(0xd800) + u"c", ec);
+		REQUIRE(ec == std::errc::illegal_byte_sequence);
+
+		ec.clear();
+		fh.print(std::u16string(1, char16_t(0xdc00)), ec);
+		REQUIRE(ec == std::errc::illegal_byte_sequence);
+
+		ec.clear();
+		fh.print(std::u32string(1, char32_t(0x110000)), ec);
+		REQUIRE(ec == std::errc::illegal_byte_sequence);
+	}
+
+	setlocale(LC_CTYPE, saved.data());
+}
@@ -322,3 +322,210 @@ TEST_CASE("error reporting")
 		REQUIRE(r.count() == 0);
 	}
 }
+
+TEST_CASE("buffers are returned to the resource")
+{
+	std::string s;
+	xstd::polyalloc::buffer_pool_resource pool(4, 64, 4096);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		file fh(std::allocator_arg, &pool, test_writer{s},
+		    opening::for_write | opening::fully_buffered, 64);
+
+		fh.print("Snow halation");
+		REQUIRE(pool.cached_blocks() == 0);
+	}
+
+	REQUIRE(pool.cached_blocks() == 1);
+	REQUIRE(s == "Snow halationSnow halationSnow halation");
+}
+
+TEST_CASE("giving back idle buffers")
+{
+	std::string s;
+	xstd::polyalloc::stats_resource st;
+
+	auto buffers_in_use = [&]
+	{
+		return st.snapshot().for_alignment(file::buffer_alignment)
+		    .bytes_in_use;
+	};
+
+	SECTION("on request")
+	{
+		file fh(std::allocator_arg, &st, test_writer{s},
+		    opening::for_write | opening::fully_buffered, 64);
+
+		REQUIRE_FALSE(fh.shrink());
+
+		fh.print("Kira-Kira ");
+		REQUIRE(buffers_in_use() == 64);
+		REQUIRE_FALSE(fh.shrink());
+
+		fh.flush();
+		REQUIRE(fh.shrink());
+		REQUIRE(buffers_in_use() == 0);
+
+		fh.print('S');
+		fh.print("ensation!");
+		REQUIRE(buffers_in_use() == 64);
+		REQUIRE(s == "Kira-Kira ");
+
+		fh.flush();
+		REQUIRE(s == "Kira-Kira Sensation!");
+	}
+
+	SECTION("when flushed")
+	{
+		file fh(std::allocator_arg, &st, test_writer{s},
+		    opening::for_write | opening::line_buffered |
+		    opening::shrink_when_idle, 64);
+
+		fh.print("Happy maker!");
+		REQUIRE(buffers_in_use() == 64);
+
+		fh.print('\n');
+		REQUIRE(buffers_in_use() == 0);
+
+		fh.print("Takaramonozu\n");
+		REQUIRE(buffers_in_use() == 0);
+		REQUIRE(s == "Happy maker!\nTakaramonozu\n");
+	}
+}
+
+TEST_CASE("adapting the buffer size")
+{
+	std::string s;
+	xstd::polyalloc::stats_resource st;
+
+	auto buffers_in_use = [&]
+	{
+		return st.snapshot().for_alignment(file::buffer_alignment)
+		    .bytes_in_use;
+	};
+
+	SECTION("grows under bulk writes")
+	{
+		file fh(std::allocator_arg, &st, test_writer{s},
+		    opening::for_write | opening::fully_buffered, 512);
+		fh.adapt_buffer(256, 8192);
+
+		std::string x(100, 'a');
+		for (int i = 0; i < 1000; ++i)
+			fh.print(x);
+
+		REQUIRE(buffers_in_use() > 512);
+		REQUIRE(buffers_in_use() <= 8192);
+
+		fh.flush();
+		REQUIRE(s.size() == 100000);
+	}
+
+	SECTION("shrinks for short lines")
+	{
+		file fh(std::allocator_arg, &st, test_writer{s},
+		    opening::for_write | opening::line_buffered, 4096);
+		fh.adapt_buffer(128, 4096);
+
+		for (int i = 0; i < 100; ++i)
+			fh.print("Aozora Jumping Heart\n");
+
+		REQUIRE(buffers_in_use() == 128);
+		REQUIRE(s.size() == 2100);
+	}
+
+	SECTION("stays within the bounds")
+	{
+		file fh(std::allocator_arg, &st, test_writer{s},
+		    opening::for_write | opening::fully_buffered, 64);
+		fh.adapt_buffer(1024, 2048);
+
+		fh.print("Mijuku DREAMER");
+		REQUIRE(buffers_in_use() == 1024);
+	}
+}
+
+TEST_CASE("changing the buffering")
+{
+	std::string s;
+	file fh(test_writer{s}, opening::for_write | opening::fully_buffered,
+	    4096);
+
+	fh.print("Natsuiro ");
+	REQUIRE(s.empty());
+
+	fh.set_buffering(opening::line_buffered, 64);
+	REQUIRE(s == "Natsuiro ");
+
+	fh.print("egao de\n1, 2, ");
+	REQUIRE(s == "Natsuiro egao de\n");
+
+	fh.set_buffering(opening::unbuffered);
+	REQUIRE(s == "Natsuiro egao de\n1, 2, ");
+
+	fh.print("Jump!");
+	REQUIRE(s == "Natsuiro egao de\n1, 2, Jump!");
+
+	fh.set_buffering(opening::fully_buffered, 1 << 22);
+	fh.print('\n');
+	REQUIRE(s == "Natsuiro egao de\n1, 2, Jump!");
+
+	fh.flush();
+	REQUIRE(s == "Natsuiro egao de\n1, 2, Jump!\n");
+}
+
+TEST_CASE("writing into the buffer in place")
+{
+	std::string s;
+
+	auto put = [](stdex::span<char> sp, stdex::string_view v)
+	{
+		REQUIRE(sp.size() >= v.size());
+		v.copy(sp.data(), v.size());
+		return v.size();
+	};
+
+	SECTION("fully buffered")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::fully_buffered, 16);
+
+		fh.commit(put(fh.prepare(10), "Snow halat"));
+		REQUIRE(s.empty());
+
+		auto sp = fh.prepare(10);
+		REQUIRE(s == "Snow halat");
+		fh.commit(put(sp, "ion"));
+
+		// larger than the buffer
+		fh.commit(put(fh.prepare(40), " shinjiteru yo"));
+		REQUIRE(s == "Snow halation");
+
+		fh.flush();
+		REQUIRE(s == "Snow halation shinjiteru yo");
+	}
+
+	SECTION("line buffered")
+	{
+		file fh(test_writer{s}, opening::for_write |
+		    opening::line_buffered, 64);
+
+		fh.commit(put(fh.prepare(8), "Bokura "));
+		REQUIRE(s.empty());
+
+		fh.commit(put(fh.prepare(8), "no\nLIVE"));
+		REQUIRE(s == "Bokura no\nLIVE");
+	}
+
+	SECTION("unbuffered")
+	{
+		file fh(test_writer{s}, opening::for_write);
+
+		fh.commit(put(fh.prepare(8), "Kimi to"));
+		REQUIRE(s == "Kimi to");
+
+		fh.print(" no LIFE");
+		REQUIRE(s == "Kimi to no LIFE");
+	}
+}
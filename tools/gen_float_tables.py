@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+#
+# Generates src/float_tables.h, the powers of five used by the shortest
+# floating-point printing in src/file_numeric.cc (after Ulf Adams, "Ryu:
+# Fast Float-to-String Conversion", PLDI 2018).
+#
+#	python3 tools/gen_float_tables.py > src/float_tables.h
+
+POW5_INV_BITCOUNT = 125
+POW5_BITCOUNT = 125
+POW5_INV_TABLE_SIZE = 342
+POW5_TABLE_SIZE = 326
+
+MASK64 = (1 << 64) - 1
+
+
+def entry(v):
+    return '\t{ 0x%016xu, 0x%016xu },' % (v & MASK64, v >> 64)
+
+
+def main():
+    print('// generated by tools/gen_float_tables.py; do not edit')
+    print()
+    print('#ifndef _STDEX_FLOAT_TABLES_H')
+    print('#define _STDEX_FLOAT_TABLES_H')
+    print()
+    print('#include <stdint.h>')
+    print()
+    print('namespace stdex')
+    print('{')
+    print()
+    print('constexpr int pow5_inv_bitcount = %d;' % POW5_INV_BITCOUNT)
+    print('constexpr int pow5_bitcount = %d;' % POW5_BITCOUNT)
+    print()
+    print('// floor(2^(bitlength(5^i) - 1 + pow5_inv_bitcount) / 5^i) + 1')
+    print('// as { low, high }')
+    print('static uint64_t const pow5_inv_split[%d][2] =' %
+          POW5_INV_TABLE_SIZE)
+    print('{')
+    for i in range(POW5_INV_TABLE_SIZE):
+        pow5 = 5 ** i
+        j = pow5.bit_length() - 1 + POW5_INV_BITCOUNT
+        print(entry((1 << j) // pow5 + 1))
+    print('};')
+    print()
+    print('// the leading pow5_bitcount bits of 5^i as { low, high }')
+    print('static uint64_t const pow5_split[%d][2] =' % POW5_TABLE_SIZE)
+    print('{')
+    for i in range(POW5_TABLE_SIZE):
+        pow5 = 5 ** i
+        shift = pow5.bit_length() - POW5_BITCOUNT
+        if shift >= 0:
+            print(entry(pow5 >> shift))
+        else:
+            print(entry(pow5 << -shift))
+    print('};')
+    print()
+    print('}')
+    print()
+    print('#endif')
+
+
+main()